@@ -0,0 +1,329 @@
+/* ------------------------------------------------------------ *
+ * file:        cal_bno080.c                                    *
+ * purpose:     Dynamic calibration data (DCD) handling. Turns  *
+ *              on the motion engine calibration, saves the DCD *
+ *              to the sensor flash, copies the DCD record to a *
+ *              host file and writes it back at startup, so the *
+ *              fusion starts with converged offsets.           *
+ *              Host copy of the DCD record via --cal-file.     *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "getbno080.h"
+
+// FRS record type of the dynamic calibration data, SH-2 6.3
+#define DCD_RECORD      0x1F1F
+// Largest DCD record we accept, in 32-bit words
+#define DCD_WORDS       256
+// Host file buffer: header line plus 9 chars per data word
+#define DCD_FILESIZE    (64 + DCD_WORDS * 9)
+// Packets without the expected response before giving up
+#define CAL_WAIT        8
+// Minimum seconds between two host backups of the DCD
+#define CAL_BACKUP_MIN  30
+// Host backup also refreshed this often while accuracy is high
+#define CAL_BACKUP_MAX  600
+
+static char *cal_file = NULL;          // --cal-file host backup
+static uint64_t cal_last = 0;          // time of the last backup
+static int cal_prev = 0;               // last seen report accuracy
+
+/* ------------------------------------------------------------ *
+ * cal_command() - run command cmd with parameters P0..P8, see  *
+ * cmd_command(). Returns the response status byte R0, or -1.   *
+ * ------------------------------------------------------------ */
+static int cal_command(uint8_t cmd, uint8_t *p) {
+   struct bnocmd c;
+   cmd_command(&c, cmd, p, OP_CALSTAT);
+   if(cmd_run(&c) != 0 || c.len[0] < 6) return(-1);
+   return(c.resp[0][5]);
+}
+
+/* ------------------------------------------------------------ *
+ * cal_config() - enable or disable the motion engine dynamic   *
+ * calibration per sensor. Configure ME Calibration, 6.4.6.1    *
+ * ------------------------------------------------------------ */
+int cal_config(int acc, int gyr, int mag) {
+   uint8_t p[9] = { acc, gyr, mag, 0x00 };  // P3 0x00 = configure
+   if(cal_command(0x07, p) != 0) {
+      printf("Error: Cannot configure ME calibration.\n");
+      return(-1);
+   }
+   if(verbose == 1) printf("Debug: OK  ME calibration acc=[%d] gyr=[%d] mag=[%d]\n",
+                            acc, gyr, mag);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * dcd_save() - store the current DCD from RAM into the sensor  *
+ * flash. Save DCD command, SH-2 reference manual 6.4.5         *
+ * ------------------------------------------------------------ */
+int dcd_save() {
+   uint8_t p[9] = { 0 };
+   if(cal_command(0x06, p) != 0) {
+      printf("Error: Sensor DCD save failed.\n");
+      return(-1);
+   }
+   if(verbose == 1) printf("Debug: OK  DCD saved to sensor flash\n");
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * dcd_autosave() - let the hub save the DCD to flash on its    *
+ * own schedule. Configure Periodic DCD Save, 6.4.7. P0 is 0 to *
+ * enable the periodic save. The hub sends no response.         *
+ * ------------------------------------------------------------ */
+int dcd_autosave(int enable) {
+   cmdsequence++;
+   uint8_t *tx = tx_begin(CHANNEL_CONTROL, 12);
+   tx[0] = COMMAND_REQUEST;
+   tx[1] = cmdsequence;
+   tx[2] = 0x09;                    // periodic DCD save CMD 0x09
+   tx[3] = enable ? 0x00 : 0x01;
+   if(sendPacket(CHANNEL_CONTROL, 12) != 0) return(-1);
+   if(verbose == 1) printf("Debug: OK  DCD periodic save %s\n", enable ? "on" : "off");
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * frs_read() - read the FRS flash record recid into words[],   *
+ * max words. The FRS read response 0xF3 carries 2 words per    *
+ * packet, SH-2 reference manual 6.3.7. Returns the word count  *
+ * (0 for an empty record), or -1 on failure.                   *
+ * ------------------------------------------------------------ */
+int frs_read(uint16_t recid, uint32_t *words, int max) {
+   uint64_t start = stats_now();
+   uint8_t *tx = tx_begin(CHANNEL_CONTROL, 8);
+   tx[0] = FRS_READ_REQUEST;
+   tx[4] = recid & 0xFF;              // FRS type LSB
+   tx[5] = recid >> 8;                // FRS type MSB
+   if(sendPacket(CHANNEL_CONTROL, 8) != 0) return(-1); // block size 0: all
+   usleep(I2CDELAY);
+
+   int total = 0, count = 0;
+   while(count < CAL_WAIT) {
+      if(sched_recv(0) == 0) {
+         count++;
+         usleep(I2CDELAY);
+         continue;
+      }
+      if(shtpHeader[2] != CHANNEL_CONTROL || shtpData[0] != FRS_READ_RESPONSE
+         || read16(&shtpData[12]) != recid) {
+         count++;
+         continue;
+      }
+      count = 0;
+      int n = shtpData[1] >> 4;          // data length in words
+      int status = shtpData[1] & 0x0F;
+      int offset = read16(&shtpData[2]);
+      if(status == 5) return(0);          // record empty
+      if(status == 1 || status == 2 || status == 4 || status == 8) {
+         printf("Error: FRS record [%04X] read status [%d].\n", recid, status);
+         return(-1);
+      }
+      for(int i = 0; i < n && offset + i < max; i++)
+         words[offset + i] = readu32(&shtpData[4 + 4*i]);
+      if(offset + n > total) total = offset + n;
+      if(total > max) {
+         printf("Error: FRS record [%04X] larger than %d words.\n", recid, max);
+         return(-1);
+      }
+      if(status == 3 || status == 6 || status == 7) {
+         stats_op(OP_FRS, start);
+         if(verbose == 1) printf("Debug: OK  FRS record [%04X] read, %d words\n", recid, total);
+         return(total);
+      }
+   }
+   return(bno_fail(ERR_TIMEOUT, "Not getting FRS read response"));
+}
+
+/* ------------------------------------------------------------ *
+ * dcd_wait() - wait for a FRS write response 0xF5, returns its *
+ * status byte, or -1 if none arrived.                          *
+ * ------------------------------------------------------------ */
+static int dcd_wait() {
+   for(int count = 0; count < CAL_WAIT; count++) {
+      if(sched_recv(0) != 0 && shtpHeader[2] == CHANNEL_CONTROL
+         && shtpData[0] == FRS_WRITE_RESPONSE) return(shtpData[1]);
+      usleep(I2CDELAY);
+   }
+   return(-1);
+}
+
+/* ------------------------------------------------------------ *
+ * frs_write() - write n words into the FRS flash record recid  *
+ * with FRS write request 0xF7, then 2 words per write data     *
+ * packet 0xF6, each one confirmed with a 0xF5 status. SH-2     *
+ * manual 6.3.4-6. The hub loads a new DCD at its next reset.   *
+ * ------------------------------------------------------------ */
+int frs_write(uint16_t recid, uint32_t *words, int n) {
+   uint64_t start = stats_now();
+   uint8_t *tx = tx_begin(CHANNEL_CONTROL, 6);
+   tx[0] = FRS__WRITE_REQUEST;
+   tx[2] = n & 0xFF;                  // length in words LSB
+   tx[3] = n >> 8;                    // length in words MSB
+   tx[4] = recid & 0xFF;
+   tx[5] = recid >> 8;
+   if(sendPacket(CHANNEL_CONTROL, 6) != 0) return(-1);
+   usleep(I2CDELAY);
+
+   int status = dcd_wait();
+   if(status != 4) {                   // 4 = write mode ready
+      printf("Error: FRS record [%04X] write not accepted, status [%d].\n", recid, status);
+      return(-1);
+   }
+
+   for(int offset = 0; offset < n; offset += 2) {
+      tx = tx_begin(CHANNEL_CONTROL, 12);
+      tx[0] = FRS__WRITE_DATA;
+      tx[2] = offset & 0xFF;
+      tx[3] = offset >> 8;
+      for(int i = 0; i < 2 && offset + i < n; i++) {
+         uint32_t w = words[offset + i];
+         tx[4+4*i] = w & 0xFF;
+         tx[5+4*i] = (w >> 8) & 0xFF;
+         tx[6+4*i] = (w >> 16) & 0xFF;
+         tx[7+4*i] = (w >> 24) & 0xFF;
+      }
+      if(sendPacket(CHANNEL_CONTROL, 12) != 0) return(-1);
+      usleep(I2CDELAY);
+
+      status = dcd_wait();
+      if(status == 3 || status == 8) break; // write completed, valid
+      if(status != 0) {
+         printf("Error: FRS write failed at word %d, status [%d].\n", offset, status);
+         return(-1);
+      }
+   }
+   if(status == 0) status = dcd_wait();     // completion after last word
+   if(status != 3 && status != 8) {
+      printf("Error: FRS write not completed, status [%d].\n", status);
+      return(-1);
+   }
+   stats_op(OP_FRS, start);
+   if(verbose == 1) printf("Debug: OK  FRS record [%04X] written, %d words\n", recid, n);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * save_cal() - save the DCD to flash, then copy the flash DCD  *
+ * record into the host file. The file is a text header line    *
+ * "bno080-dcd <words>" followed by one hex word per line, it   *
+ * is replaced atomically.                                      *
+ * ------------------------------------------------------------ */
+int save_cal(char *file) {
+   uint32_t words[DCD_WORDS];
+   char buf[DCD_FILESIZE];
+
+   if(dcd_save() != 0) return(-1);
+   int n = frs_read(DCD_RECORD, words, DCD_WORDS);
+   if(n <= 0) {
+      printf("Error: Sensor has no DCD record to save.\n");
+      return(-1);
+   }
+
+   int len = snprintf(buf, sizeof(buf), "bno080-dcd %d\n", n);
+   for(int i = 0; i < n; i++)
+      len += snprintf(buf+len, sizeof(buf)-len, "%08X\n", words[i]);
+   if(publish_file(file, buf, len) != 0) return(-1);
+   if(verbose == 1) printf("Debug: DCD saved to file: [%s]\n", file);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * cal_readfile() - read a DCD host file written by save_cal()  *
+ * into words[]. Returns the word count, or -1 on failure.      *
+ * ------------------------------------------------------------ */
+static int cal_readfile(char *file, uint32_t *words) {
+   int n = 0;
+
+   FILE *calib;
+   if(! (calib=fopen(file, "r"))) {
+      printf("Error: Can't open %s for reading.\n", file);
+      return(-1);
+   }
+   if(verbose == 1) printf("Debug: Load from file: [%s]\n", file);
+
+   if(fscanf(calib, "bno080-dcd %d", &n) != 1 || n <= 0 || n > DCD_WORDS) {
+      printf("Error: %s is not a BNO080 DCD file.\n", file);
+      fclose(calib);
+      return(-1);
+   }
+   for(int i = 0; i < n; i++) {
+      if(fscanf(calib, "%8x", &words[i]) != 1) {
+         printf("Error: %s has %d of %d DCD words.\n", file, i, n);
+         fclose(calib);
+         return(-1);
+      }
+   }
+   fclose(calib);
+   return(n);
+}
+
+/* ------------------------------------------------------------ *
+ * load_cal() load previously saved calibration data from file  *
+ * into the DCD flash record, then reset the sensor to apply it *
+ * ------------------------------------------------------------ */
+int load_cal(char *file) {
+   uint32_t words[DCD_WORDS];
+   int n = cal_readfile(file, words);
+   if(n < 0) return(-1);
+   if(frs_write(DCD_RECORD, words, n) != 0) return(-1);
+   return(bno_reset());
+}
+
+/* ------------------------------------------------------------ *
+ * cal_start() - restore the host backup if there is one and it *
+ * differs from the DCD in flash, then enable the dynamic       *
+ * calibration and the hub's periodic save. A matching backup   *
+ * costs no flash write and no reset. Call before any report is *
+ * enabled.                                                     *
+ * ------------------------------------------------------------ */
+int cal_start(char *file) {
+   uint32_t words[DCD_WORDS], flash[DCD_WORDS];
+   cal_file = file;
+   if(access(file, R_OK) == 0) {
+      int n = cal_readfile(file, words);
+      int cur = (n > 0) ? frs_read(DCD_RECORD, flash, DCD_WORDS) : -1;
+      if(n > 0 && cur == n && memcmp(words, flash, n * sizeof(uint32_t)) == 0) {
+         if(verbose == 1) printf("Debug: OK  DCD in flash matches [%s]\n", file);
+      }
+      else if(n < 0 || frs_write(DCD_RECORD, words, n) != 0 || bno_reset() != 0)
+         printf("Error: DCD restore from %s failed, calibrating from scratch.\n", file);
+      else if(verbose == 1) printf("Debug: OK  DCD restored from [%s]\n", file);
+   }
+   if(cal_config(1, 1, 1) != 0) return(-1);
+   return(dcd_autosave(1));
+}
+
+/* ------------------------------------------------------------ *
+ * cal_poll() - autosave policy, called with the accuracy of    *
+ * each streamed report. The host backup is refreshed when the  *
+ * accuracy reaches high (3), at most every CAL_BACKUP_MIN and  *
+ * at least every CAL_BACKUP_MAX seconds while it stays high.   *
+ * ------------------------------------------------------------ */
+void cal_poll(uint8_t status) {
+   if(cal_file == NULL) return;
+   int prev = cal_prev;
+   cal_prev = status;
+   if(status != 3) return;
+
+   uint64_t age = (stats_now() - cal_last) / 1000000000ULL;
+   if(cal_last != 0 && age < CAL_BACKUP_MIN) return;
+   if(prev == 3 && cal_last != 0 && age < CAL_BACKUP_MAX) return;
+   save_cal(cal_file);              // failures retry after the min
+   cal_last = stats_now();
+}
+
+/* ------------------------------------------------------------ *
+ * cal_stop() - final host backup if the accuracy is high       *
+ * ------------------------------------------------------------ */
+void cal_stop() {
+   if(cal_file == NULL || cal_prev != 3) return;
+   save_cal(cal_file);
+   cal_file = NULL;
+}
@@ -0,0 +1,191 @@
+/* ------------------------------------------------------------ *
+ * file:        cmd_bno080.c                                    *
+ * purpose:     Asynchronous SHTP request layer. Callers set up *
+ *              several requests, submit them back-to-back and  *
+ *              wait once. Responses are matched to requests by *
+ *              channel, report ID and the command sequence,    *
+ *              FRS record type or response count, so they may  *
+ *              arrive in any order and overlap on the bus.     *
+ *              cmd_run() is the one-request blocking call.     *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "getbno080.h"
+
+// Max requests in flight at the same time
+#define CMD_SLOTS       8
+// Max wait for all submitted requests to complete, in millisecs
+#define CMD_TIMEOUT_MS  1000
+
+static __thread struct bnocmd *pending[CMD_SLOTS];
+static __thread int npending = 0;
+
+/* ------------------------------------------------------------ *
+ * cmd_init() - prepare request c: len bytes of req go to chan, *
+ * expect responses with report ID report on channel rchan.     *
+ * ------------------------------------------------------------ */
+void cmd_init(struct bnocmd *c, uint8_t chan, uint8_t *req, int len,
+              uint8_t rchan, uint8_t report, int expect, int op) {
+   memset(c, 0, sizeof(struct bnocmd));
+   c->chan = chan;
+   memcpy(c->req, req, len);
+   c->reqlen = len;
+   c->rchan = rchan;
+   c->report = report;
+   c->expect = expect;
+   c->op = op;
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_command() - prepare a 0xF2 command request with P0..P8,  *
+ * completed by the 0xF1 response carrying the same command and *
+ * command sequence number. SH-2 reference manual 6.3.8/6.3.9   *
+ * ------------------------------------------------------------ */
+void cmd_command(struct bnocmd *c, uint8_t cmd, uint8_t *p, int op) {
+   uint8_t req[12];
+   cmdsequence++;
+   req[0] = COMMAND_REQUEST;          // CMD request
+   req[1] = cmdsequence;              // report sequence number
+   req[2] = cmd;                      // command
+   memcpy(&req[3], p, 9);             // P0..P8
+   cmd_init(c, CHANNEL_CONTROL, req, 12, CHANNEL_CONTROL, COMMAND_RESPONSE, 1, op);
+   c->cmd = cmd;
+   c->seq = cmdsequence;
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_frs() - prepare a FRS read request 0xF4 for record recid,*
+ * completed by the 0xF3 response of that FRS type. SH-2 6.3.7  *
+ * ------------------------------------------------------------ */
+void cmd_frs(struct bnocmd *c, uint16_t recid) {
+   uint8_t req[8] = { FRS_READ_REQUEST, 0x00, 0x00, 0x00, recid & 0xFF, recid >> 8, 0x00, 0x00 };
+   cmd_init(c, CHANNEL_CONTROL, req, 8, CHANNEL_CONTROL, FRS_READ_RESPONSE, 1, OP_FRS);
+   c->frs = recid;
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_submit() - send the request and register it as pending.  *
+ * Returns 0, or -1 if the table is full or the send failed.    *
+ * ------------------------------------------------------------ */
+int cmd_submit(struct bnocmd *c) {
+   if(npending == CMD_SLOTS) {
+      printf("Error: more than %d SHTP requests pending.\n", CMD_SLOTS);
+      c->state = CMD_FAILED;
+      return(-1);
+   }
+   c->got = 0;
+   c->start = stats_now();
+   memcpy(tx_begin(c->chan, 0), c->req, c->reqlen);
+   if(sendPacket(c->chan, c->reqlen) != 0) {
+      c->state = CMD_FAILED;
+      return(-1);
+   }
+   c->state = CMD_PENDING;
+   pending[npending++] = c;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_remove() - drop pending entry i, order is not kept       *
+ * ------------------------------------------------------------ */
+static void cmd_remove(int i) {
+   pending[i] = pending[--npending];
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_match() - offer the packet in shtpHeader[]/shtpData[] of *
+ * datalen cargo bytes to the pending requests. Returns 1 if it *
+ * was a response to one of them, 0 if not.                     *
+ * ------------------------------------------------------------ */
+int cmd_match(int datalen) {
+   if(npending == 0 || datalen < 1) return(0);
+
+   for(int i = 0; i < npending; i++) {
+      struct bnocmd *c = pending[i];
+      if(shtpHeader[2] != c->rchan || shtpData[0] != c->report) continue;
+      if(c->report == COMMAND_RESPONSE
+         && (datalen < 4 || shtpData[2] != c->cmd || shtpData[3] != c->seq)) continue;
+      if(c->report == FRS_READ_RESPONSE
+         && (datalen < 14 || read16(&shtpData[12]) != c->frs)) continue;
+      if(c->report == GET_FEATURE_RESPONSE
+         && (datalen < 2 || shtpData[1] != c->cmd)) continue;
+
+      int len = (datalen < CMD_RESPMAX) ? datalen : CMD_RESPMAX;
+      memcpy(c->resp[c->got], shtpData, len);
+      c->len[c->got] = len;
+      if(++c->got == c->expect) {
+         c->state = CMD_DONE;
+         stats_op(c->op, c->start);
+         cmd_remove(i);
+      }
+      return(1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_wait() - receive packets until all pending requests are  *
+ * done or CMD_TIMEOUT_MS has passed. Unanswered requests fail  *
+ * and start one recovery. Returns the number of failures.      *
+ * ------------------------------------------------------------ */
+int cmd_wait() {
+   uint64_t deadline = stats_now() + CMD_TIMEOUT_MS * 1000000ULL;
+
+   while(npending > 0 && stats_now() < deadline) {
+      int datalen = sched_recv(0);
+      if(datalen == 0) {
+         usleep(I2CDELAY);                // hub has no data yet
+         continue;
+      }
+      if(cmd_match(datalen) == 0 && verbose == 1)
+         printf("Debug: Unrequested packet chan [%d] report [%02X]\n",
+                 shtpHeader[2], shtpData[0]);
+   }
+
+   int failed = npending;
+   while(npending > 0) {
+      if(verbose == 1) printf("Debug: No response to request [%02X] on chan [%d]\n",
+                               pending[0]->req[0], pending[0]->chan);
+      pending[0]->state = CMD_FAILED;
+      cmd_remove(0);
+   }
+   if(failed > 0) bno_recover(ERR_TIMEOUT);
+   return(failed);
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_expire() - fail the requests without a response after    *
+ * CMD_TIMEOUT_MS, for requests completed by the stream loop.   *
+ * Doesn't wait and doesn't recover, the caller sees the state. *
+ * ------------------------------------------------------------ */
+void cmd_expire() {
+   uint64_t now = stats_now();
+   for(int i = 0; i < npending; i++) {
+      if(now - pending[i]->start < CMD_TIMEOUT_MS * 1000000ULL) continue;
+      if(verbose == 1) printf("Debug: No response to request [%02X] on chan [%d]\n",
+                               pending[i]->req[0], pending[i]->chan);
+      pending[i]->state = CMD_FAILED;
+      cmd_remove(i--);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_run() - submit one request and wait for its completion.  *
+ * Returns 0, or -1 if it failed.                               *
+ * ------------------------------------------------------------ */
+int cmd_run(struct bnocmd *c) {
+   if(cmd_submit(c) != 0) return(-1);
+   cmd_wait();
+   return((c->state == CMD_DONE) ? 0 : -1);
+}
+
+/* ------------------------------------------------------------ *
+ * cmd_pending() - number of requests waiting for a response    *
+ * ------------------------------------------------------------ */
+int cmd_pending() {
+   return(npending);
+}
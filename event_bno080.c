@@ -0,0 +1,273 @@
+/* ------------------------------------------------------------ *
+ * file:        event_bno080.c                                  *
+ * purpose:     Event-only low power mode for --events. The tap *
+ *              detector, step counter, stability and activity  *
+ *              classifiers run as wake reports on channel 4,   *
+ *              the hub sleeps in between. A poller thread owns *
+ *              the bus: it coalesces each burst of wake        *
+ *              reports into one event, queues it and signals   *
+ *              an eventfd, so the consumer can sleep in epoll. *
+ *              The poll interval backs off to EV_IDLE_MS while *
+ *              no burst is open, the host stays near idle.     *
+ *              The poller answers the SIGUSR1/SIGUSR2 requests *
+ *              and hands its counters to the main thread at    *
+ *              its end, the driver state is thread-local.      *
+ *              Enabled with --events, see stream_events().     *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "getbno080.h"
+
+// Events queued between the poller and the consumer, a power of 2
+#define EV_QLEN        64
+// A burst ends after this quiet time, in millisecs
+#define EV_COALESCE_MS 20
+// A burst is cut into events of at most this length, in millisecs
+#define EV_BURST_MS    200
+// Longest poll sleep while no burst is open, in millisecs
+#define EV_IDLE_MS     50
+
+static const uint8_t ev_reports[] = {
+   SENSOR_REPORTID_TAP, SENSOR_REPORTID_STP, SENSOR_REPORTID_STA, SENSOR_REPORTID_PER
+};
+
+/* ------------------------------------------------------------ *
+ * Event queue: the poller owns head, the consumer owns tail,   *
+ * as the multi-bus queues.                                     *
+ * ------------------------------------------------------------ */
+static struct bnoevent ev_q[EV_QLEN];
+static uint32_t ev_head __attribute__((aligned(64)));
+static uint32_t ev_tail __attribute__((aligned(64)));
+
+static int ev_fd = -1;                   // eventfd, counts queued events
+static int ev_run = 0;
+static int ev_ready = 0;                 // 1 = poller is up, -1 = failed
+static int ev_live = 0;                  // poller thread runs
+static pthread_t ev_thread;
+static char ev_bus[256], ev_addr[8];
+static uint32_t ev_us;
+static char *ev_statsfile;               // --stats-file for SIGUSR1
+static struct bnostats *ev_stats;        // stats of the consumer thread
+
+// Poller side counters, read by ev_print() after ev_stop()
+static uint64_t ev_events, ev_nrep, ev_drops, ev_polls;
+static uint64_t ev_start_ns, ev_stop_ns;
+
+// Open burst, only used on the poller thread
+static __thread int ev_on = 0;
+static __thread struct bnoevent cur;
+static __thread uint64_t cur_first, cur_last;
+
+/* ------------------------------------------------------------ *
+ * ev_arrival() - an input report came in, called after decode. *
+ * Event reports are added to the open burst, or open one.      *
+ * ------------------------------------------------------------ */
+void ev_arrival(uint8_t repid) {
+   if(ev_on == 0) return;
+   uint8_t bit;
+   switch(repid) {
+      case SENSOR_REPORTID_TAP: bit = EV_TAP; break;
+      case SENSOR_REPORTID_STP: bit = EV_STEP; break;
+      case SENSOR_REPORTID_STA: bit = EV_STABILITY; break;
+      case SENSOR_REPORTID_PER: bit = EV_ACTIVITY; break;
+      default: return;
+   }
+   uint64_t now = stats_now();
+   if(cur.reports == 0) {
+      memset(&cur, 0, sizeof(cur));
+      cur.ts = sink_clock();
+      cur_first = now;
+   }
+   cur_last = now;
+   cur.reports++;
+   cur.mask |= bit;
+   if(bit == EV_TAP) cur.tap |= tapDetector;
+   cur.steps = stepCount;
+   cur.stability = stabilityClassifier;
+   cur.activity = activityClassifier;
+   ev_nrep++;
+}
+
+/* ------------------------------------------------------------ *
+ * ev_close() - queue the open burst as one event and signal    *
+ * ------------------------------------------------------------ */
+static void ev_close() {
+   uint64_t one = 1;
+   cur.span = (cur_last - cur_first) / 1000;
+   if(ev_head - __atomic_load_n(&ev_tail, __ATOMIC_ACQUIRE) == EV_QLEN) ev_drops++;
+   else {
+      ev_q[ev_head & (EV_QLEN - 1)] = cur;
+      __atomic_store_n(&ev_head, ev_head + 1, __ATOMIC_RELEASE);
+      if(write(ev_fd, &one, sizeof(one)) != sizeof(one) && verbose == 1)
+         printf("Debug: Event signal failed\n");
+   }
+   ev_events++;
+   cur.reports = 0;
+}
+
+/* ------------------------------------------------------------ *
+ * ev_setup() - enable the event reports as wake reports, then  *
+ * put the hub to sleep. Runs on the poller thread.             *
+ * ------------------------------------------------------------ */
+static int ev_setup() {
+   stats_init(ev_bus, ev_addr);
+   if(shtp_init(ev_bus, ev_addr) != 0) return(-1);
+   for(int i = 0; i < ARRAY_ITEMS(ev_reports); i++) {
+      featureFlags[ev_reports[i]] = FEATURE_WAKE;
+      if(set_feature(ev_reports[i], ev_us) != 0) {
+         printf("Error: Cannot enable wake report [%02X].\n", ev_reports[i]);
+         return(-1);
+      }
+   }
+   return(set_power(low));
+}
+
+/* ------------------------------------------------------------ *
+ * ev_end() - poller exit: merge the thread-local stats and -v  *
+ * trace into the consumer's, then wake the consumer so it sees *
+ * the poller is gone.                                          *
+ * ------------------------------------------------------------ */
+static void ev_end() {
+   uint64_t one = 1;
+   stats_merge(ev_stats);
+   if(verbose == 1) trace_dump(stdout);
+   __atomic_store_n(&ev_live, 0, __ATOMIC_RELEASE);
+   if(write(ev_fd, &one, sizeof(one)) != sizeof(one) && verbose == 1)
+      printf("Debug: Event signal failed\n");
+}
+
+/* ------------------------------------------------------------ *
+ * ev_loop() - the poller thread. A report resets the sleep to  *
+ * I2CDELAY, each empty poll doubles it, up to a quarter of the *
+ * coalescing time in a burst and up to EV_IDLE_MS outside.     *
+ * The poller ends early if the recovery lost the hub.          *
+ * ------------------------------------------------------------ */
+static void *ev_loop(void *arg) {
+   uint32_t nap = I2CDELAY;
+   if(ev_setup() != 0) {
+      ev_end();
+      __atomic_store_n(&ev_ready, -1, __ATOMIC_RELEASE);
+      return(NULL);
+   }
+   ev_on = 1;
+   ev_start_ns = stats_now();
+   __atomic_store_n(&ev_ready, 1, __ATOMIC_RELEASE);
+
+   while(__atomic_load_n(&ev_run, __ATOMIC_RELAXED)) {
+      stats_poll(ev_statsfile);
+      trace_poll();
+      if(stats.recov[RECOV_FAILED] > 0) {
+         printf("Error: Lost the sensor, event poller ends.\n");
+         break;
+      }
+      int rid = get_report();
+      ev_polls++;
+      uint64_t now = stats_now();
+      if(cur.reports > 0 && (now - cur_last > EV_COALESCE_MS * 1000000ULL
+                             || now - cur_first > EV_BURST_MS * 1000000ULL)) ev_close();
+      if(rid != 0) {
+         nap = I2CDELAY;
+         continue;
+      }
+      usleep(nap);
+      uint32_t cap = (cur.reports > 0) ? EV_COALESCE_MS * 250 : EV_IDLE_MS * 1000;
+      nap = (nap * 2 < cap) ? nap * 2 : cap;
+   }
+   if(cur.reports > 0) ev_close();
+   ev_on = 0;
+   ev_stop_ns = stats_now();
+
+   // back to normal: event reports off, hub awake
+   for(int i = 0; i < ARRAY_ITEMS(ev_reports) && stats.recov[RECOV_FAILED] == 0; i++) {
+      featureFlags[ev_reports[i]] = 0;
+      set_feature(ev_reports[i], 0);
+   }
+   if(stats.recov[RECOV_FAILED] == 0) set_power(normal);
+   close(i2cfd);
+   ev_end();
+   return(NULL);
+}
+
+/* ------------------------------------------------------------ *
+ * ev_start() - start the poller on bus and addr, event reports *
+ * at most every usec, SIGUSR1 stats go to file. Returns the    *
+ * eventfd to wait on, it reads as the number of events queued  *
+ * since the last read, or -1. The fd is also signaled once the *
+ * poller has ended, see ev_alive().                            *
+ * ------------------------------------------------------------ */
+int ev_start(char *bus, char *addr, uint32_t usec, char *file) {
+   snprintf(ev_bus, sizeof(ev_bus), "%s", bus);
+   snprintf(ev_addr, sizeof(ev_addr), "%s", addr);
+   ev_us = usec;
+   ev_statsfile = file;
+   ev_stats = &stats;
+   if((ev_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+      printf("Error: Cannot create the event fd.\n");
+      return(-1);
+   }
+   ev_run = 1;
+   ev_live = 1;
+   if(pthread_create(&ev_thread, NULL, ev_loop, NULL) != 0) {
+      printf("Error: Cannot start the event poller thread.\n");
+      ev_live = 0;
+      return(-1);
+   }
+   while(__atomic_load_n(&ev_ready, __ATOMIC_ACQUIRE) == 0) usleep(1000);
+   if(ev_ready < 0) {
+      pthread_join(ev_thread, NULL);
+      ev_run = 0;
+      return(-1);
+   }
+   if(verbose == 1) printf("Debug: Wake events, %u usec report interval, %d ms coalescing\n",
+                            usec, EV_COALESCE_MS);
+   return(ev_fd);
+}
+
+/* ------------------------------------------------------------ *
+ * ev_take() - copy the oldest queued event to e, returns 1, or *
+ * 0 if the queue is empty                                      *
+ * ------------------------------------------------------------ */
+int ev_take(struct bnoevent *e) {
+   if(__atomic_load_n(&ev_head, __ATOMIC_ACQUIRE) == ev_tail) return(0);
+   *e = ev_q[ev_tail & (EV_QLEN - 1)];
+   __atomic_store_n(&ev_tail, ev_tail + 1, __ATOMIC_RELEASE);
+   return(1);
+}
+
+/* ------------------------------------------------------------ *
+ * ev_alive() - 1 while the poller runs, 0 once it has ended    *
+ * ------------------------------------------------------------ */
+int ev_alive() {
+   return(__atomic_load_n(&ev_live, __ATOMIC_ACQUIRE));
+}
+
+/* ------------------------------------------------------------ *
+ * ev_stop() - end the poller, the hub is back to normal power  *
+ * ------------------------------------------------------------ */
+void ev_stop() {
+   if(__atomic_load_n(&ev_run, __ATOMIC_RELAXED) == 0) return;
+   __atomic_store_n(&ev_run, 0, __ATOMIC_RELAXED);
+   pthread_join(ev_thread, NULL);
+   close(ev_fd);
+}
+
+/* ------------------------------------------------------------ *
+ * ev_print() - event and bus poll counters for --stats         *
+ * ------------------------------------------------------------ */
+void ev_print(FILE *fp) {
+   double secs = (ev_stop_ns > ev_start_ns) ? (ev_stop_ns - ev_start_ns) / 1e9 : 0;
+   fprintf(fp, "\nBNO080 wake events, %d ms coalescing, %d ms idle poll\n",
+           EV_COALESCE_MS, EV_IDLE_MS);
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Events %llu from %llu wake reports, %llu dropped\n",
+           (unsigned long long) ev_events, (unsigned long long) ev_nrep,
+           (unsigned long long) ev_drops);
+   fprintf(fp, "Bus polls %llu in %.1f s, %.1f per second\n", (unsigned long long) ev_polls,
+           secs, (secs > 0) ? ev_polls / secs : 0.0);
+}
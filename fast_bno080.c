@@ -0,0 +1,103 @@
+/* ------------------------------------------------------------ *
+ * file:        fast_bno080.c                                   *
+ * purpose:     Fast lane for the gyro-integrated rotation      *
+ *              vector on SHTP channel 5, up to 1 kHz. The hub  *
+ *              sends it without report header and timestamp,   *
+ *              so it skips the report table walk: get_report() *
+ *              hands channel 5 packets here before any other   *
+ *              packet handling, the fixed layout is decoded in *
+ *              place and published to a single-slot mailbox.   *
+ *              Readers always get the newest sample, older     *
+ *              ones are overwritten and counted. The lane has  *
+ *              its own latency histograms for --latency.       *
+ *              Selected with -t gir, readers use fast_take().  *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "getbno080.h"
+
+// Channel 5 cargo: quaternion I J K real, angular velocity X Y Z
+#define FAST_LEN 14
+
+/* ------------------------------------------------------------ *
+ * Mailbox, a sequence lock around one sample. The writer makes *
+ * seq odd while it copies, readers retry on an odd or changed  *
+ * seq. Neither side blocks, the slot has its own cache line.   *
+ * ------------------------------------------------------------ */
+static struct {
+   uint32_t seq;
+   struct gyrosample smp;
+} box __attribute__((aligned(64)));
+
+static uint32_t fast_seen = 0;           // publish count of the last take
+static uint64_t fast_lost = 0;           // overwritten before a take
+static struct hist fast_lat[2];          // publish, take; usecs since rx
+
+/* ------------------------------------------------------------ *
+ * fast_rx() - decode the channel 5 packet of datalen bytes in  *
+ * shtpData[] and publish it. Called by get_report() right      *
+ * after the read. Returns SENSOR_REPORTID_GIR, or 0 if short.  *
+ * ------------------------------------------------------------ */
+int fast_rx(int datalen) {
+   struct gyrosample g;
+   if(datalen < FAST_LEN) return(0);
+   for(int i = 0; i < 4; i++) g.q[i] = (int16_t) read16(&shtpData[2*i]);
+   for(int i = 0; i < 3; i++) g.w[i] = (int16_t) read16(&shtpData[8 + 2*i]);
+   g.rx = reptime.rx;
+
+   uint32_t seq = box.seq;
+   g.seq = seq / 2 + 1;
+   __atomic_store_n(&box.seq, seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   memcpy(&box.smp, &g, sizeof(g));
+   __atomic_store_n(&box.seq, seq + 2, __ATOMIC_RELEASE);
+
+   hist_add(&fast_lat[0], (stats_now() - g.rx) / 1000);
+   wd_arrival(SENSOR_REPORTID_GIR);
+   return(SENSOR_REPORTID_GIR);
+}
+
+/* ------------------------------------------------------------ *
+ * fast_take() - copy the newest sample to g. Returns 1 if it   *
+ * is new since the last take, 0 if not. Takes are for a single *
+ * consumer, it owns the take latency and the lost count.       *
+ * ------------------------------------------------------------ */
+int fast_take(struct gyrosample *g) {
+   uint32_t seq;
+   do {
+      while((seq = __atomic_load_n(&box.seq, __ATOMIC_ACQUIRE)) & 1) ;
+      memcpy(g, &box.smp, sizeof(*g));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   } while(__atomic_load_n(&box.seq, __ATOMIC_RELAXED) != seq);
+
+   if(g->seq == fast_seen) return(0);
+   fast_lost += g->seq - fast_seen - 1;
+   fast_seen = g->seq;
+   hist_add(&fast_lat[1], (stats_now() - g->rx) / 1000);
+   return(1);
+}
+
+/* ------------------------------------------------------------ *
+ * fast_print() - fast lane latency table for --latency, from   *
+ * the channel 5 read to publish and to take                    *
+ * ------------------------------------------------------------ */
+void fast_print(FILE *fp) {
+   static const char *stage[2] = { "publish", "take" };
+   if(fast_lat[0].count == 0) return;
+   fprintf(fp, "\nBNO080 gyro fast lane, channel 5 read to each stage\n");
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Stage        count     min     p50     p99    p999     max (usec)\n");
+   for(int s = 0; s < 2; s++) {
+      struct hist *h = &fast_lat[s];
+      fprintf(fp, "%-8s %9llu %7llu %7llu %7llu %7llu %7llu\n", stage[s],
+              (unsigned long long) h->count, (unsigned long long) h->min,
+              (unsigned long long) hist_pct(h, 50.0),
+              (unsigned long long) hist_pct(h, 99.0),
+              (unsigned long long) hist_pct(h, 99.9),
+              (unsigned long long) h->max);
+   }
+   fprintf(fp, "Samples overwritten before a take: %llu\n", (unsigned long long) fast_lost);
+}
@@ -0,0 +1,287 @@
+/* ------------------------------------------------------------ *
+ * file:        filt_bno080.c                                   *
+ * purpose:     Host-side filter and decimation stage for the   *
+ *              sample stream. Samples are collected in batches *
+ *              (win_bno080.c windows), converted to float once *
+ *              and run through a chain of IIR low-pass, moving *
+ *              average and decimating FIR stages. The kernels  *
+ *              use GCC vector extensions, 4 floats per vector, *
+ *              which map to NEON on the Pi and SSE on x86.     *
+ *              Filtered samples go back to Q-point format.     *
+ *              The --filter stage list is read by filt_parse().*
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "getbno080.h"
+
+// Filter stages in one chain
+#define FILT_STAGES 4
+// Samples per batch, one window of the sample stream
+#define FILT_BATCH  64
+// Max FIR taps, a multiple of 4
+#define FILT_TAPS   64
+// Taps per decimation factor of the FIR decimator
+#define FILT_TAPS_PER_M 8
+
+typedef float v4f __attribute__((vector_size(16)));
+
+typedef enum {
+   FILT_IIR = 0x00,     // 2nd order Butterworth low-pass
+   FILT_MA  = 0x01,     // moving average
+   FILT_FIR = 0x02      // windowed-sinc low-pass, decimating
+} filttype_t;
+
+struct filtstage{
+   filttype_t type;
+   int   decim;                          // keep every decim-th output
+   int   phase;                          // input index of next output
+   int   ntaps;                          // FIR taps, multiple of 4
+   float taps[FILT_TAPS] __attribute__((aligned(16))); // reversed taps
+   float hist[4][FILT_TAPS] __attribute__((aligned(16))); // last inputs
+   v4f   b0, b1, b2, a1, a2;             // biquad, same for all axes
+   v4f   z1, z2;                         // biquad state, one lane per axis
+};
+
+static struct filtstage stage[FILT_STAGES];
+static int nstages = 0;
+static float in_hz = 0;                  // input sample rate
+static struct bnowin filt_win;
+static void (*filt_out)(struct bnosample*, void*);
+static void *filt_arg;
+
+/* ------------------------------------------------------------ *
+ * Ping-pong batch buffers. The FIR stages need their history   *
+ * in front of the batch, so the batch starts at FILT_TAPS.     *
+ * ------------------------------------------------------------ */
+static float buf[2][4][FILT_TAPS + FILT_BATCH] __attribute__((aligned(64)));
+static uint32_t tsbuf[2][FILT_BATCH];
+
+/* ------------------------------------------------------------ *
+ * filt_iir() - RBJ biquad low-pass at fc Hz, Q = 1/sqrt(2)     *
+ * ------------------------------------------------------------ */
+static int filt_iir(struct filtstage *st, float fc, float fs) {
+   if(fc <= 0 || fc >= fs / 2) {
+      printf("Error: low-pass %.1f Hz must be below %.1f Hz.\n", fc, fs / 2);
+      return(-1);
+   }
+   float w0 = 2 * M_PI * fc / fs;
+   float alpha = sinf(w0) / (2 * M_SQRT1_2);
+   float a0 = 1 + alpha;
+   float c = cosf(w0);
+   v4f one = { 1, 1, 1, 1 };
+   st->b0 = one * ((1 - c) / 2 / a0);
+   st->b1 = one * ((1 - c) / a0);
+   st->b2 = st->b0;
+   st->a1 = one * (-2 * c / a0);
+   st->a2 = one * ((1 - alpha) / a0);
+   st->decim = 1;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * filt_taps() - set n taps, padded with zeros to a multiple of *
+ * 4 and stored reversed for the forward dot product.           *
+ * ------------------------------------------------------------ */
+static void filt_taps(struct filtstage *st, float *h, int n) {
+   st->ntaps = (n + 3) & ~3;
+   memset(st->taps, 0, sizeof(st->taps));
+   for(int i = 0; i < n; i++) st->taps[st->ntaps - 1 - i] = h[i];
+}
+
+/* ------------------------------------------------------------ *
+ * filt_fir() - Hamming windowed-sinc low-pass for decimation   *
+ * by m, cutoff at 80% of the output Nyquist frequency.         *
+ * ------------------------------------------------------------ */
+static int filt_fir(struct filtstage *st, int m) {
+   float h[FILT_TAPS];
+   int n = FILT_TAPS_PER_M * m + 1;
+   if(m < 2 || n > FILT_TAPS - 3) {
+      printf("Error: FIR decimation must be 2..%d.\n", (FILT_TAPS - 4) / FILT_TAPS_PER_M);
+      return(-1);
+   }
+   float fc = 0.8f * 0.5f / m;           // cycles per input sample
+   float sum = 0;
+   for(int i = 0; i < n; i++) {
+      float t = i - (n - 1) / 2.0f;
+      h[i] = (t == 0) ? 2 * fc : sinf(2 * M_PI * fc * t) / (M_PI * t);
+      h[i] *= 0.54f - 0.46f * cosf(2 * M_PI * i / (n - 1));
+      sum += h[i];
+   }
+   for(int i = 0; i < n; i++) h[i] /= sum;  // unity gain at DC
+   filt_taps(st, h, n);
+   st->decim = m;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * filt_ma() - moving average over n samples                    *
+ * ------------------------------------------------------------ */
+static int filt_ma(struct filtstage *st, int n) {
+   float h[FILT_TAPS];
+   if(n < 2 || n > FILT_TAPS) {
+      printf("Error: moving average length must be 2..%d.\n", FILT_TAPS);
+      return(-1);
+   }
+   for(int i = 0; i < n; i++) h[i] = 1.0f / n;
+   filt_taps(st, h, n);
+   st->decim = 1;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * filt_parse() - set up the chain from a comma separated spec: *
+ * lp:hz (low-pass), ma:n (moving average), fir:m (decimate).   *
+ * rate_hz is the input sample rate. Returns 0 or -1.           *
+ * ------------------------------------------------------------ */
+int filt_parse(char *spec, float rate_hz) {
+   char copy[256];
+   strncpy(copy, spec, sizeof(copy)-1);
+   copy[sizeof(copy)-1] = '\0';
+   in_hz = rate_hz;
+   nstages = 0;
+
+   float fs = rate_hz;                   // rate at the current stage
+   for(char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+      if(nstages == FILT_STAGES) {
+         printf("Error: more than %d filter stages.\n", FILT_STAGES);
+         return(-1);
+      }
+      struct filtstage *st = &stage[nstages];
+      memset(st, 0, sizeof(struct filtstage));
+      float arg;
+      int res;
+      if(sscanf(tok, "lp:%f", &arg) == 1) {
+         st->type = FILT_IIR;
+         res = filt_iir(st, arg, fs);
+      }
+      else if(sscanf(tok, "ma:%f", &arg) == 1) {
+         st->type = FILT_MA;
+         res = filt_ma(st, (int) arg);
+      }
+      else if(sscanf(tok, "fir:%f", &arg) == 1) {
+         st->type = FILT_FIR;
+         res = filt_fir(st, (int) arg);
+      }
+      else {
+         printf("Error: unknown filter stage [%s].\n", tok);
+         return(-1);
+      }
+      if(res != 0) return(-1);
+      fs /= st->decim;
+      nstages++;
+   }
+   if(verbose == 1) printf("Debug: Filter chain %d stages, %.1f Hz in, %.1f Hz out\n",
+                            nstages, in_hz, fs);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * run_iir() - the biquad is recursive in time, so the vector   *
+ * runs across the 4 axes, one lane each. Transposed direct     *
+ * form II, in place.                                           *
+ * ------------------------------------------------------------ */
+static int run_iir(struct filtstage *st, float *x[4], int n) {
+   v4f z1 = st->z1, z2 = st->z2;
+   for(int i = 0; i < n; i++) {
+      v4f in = { x[0][i], x[1][i], x[2][i], x[3][i] };
+      v4f y = st->b0 * in + z1;
+      z1 = st->b1 * in - st->a1 * y + z2;
+      z2 = st->b2 * in - st->a2 * y;
+      x[0][i] = y[0]; x[1][i] = y[1]; x[2][i] = y[2]; x[3][i] = y[3];
+   }
+   st->z1 = z1;
+   st->z2 = z2;
+   return(n);
+}
+
+/* ------------------------------------------------------------ *
+ * run_fir() - FIR with decimation, only the kept outputs are   *
+ * computed. The history sits in front of x[a], the dot product *
+ * runs 4 taps per vector. ts[] follows the outputs. Returns    *
+ * the number of outputs in out[] and ts[].                     *
+ * ------------------------------------------------------------ */
+static int run_fir(struct filtstage *st, float *x[4], int n, float *out[4], uint32_t *ts) {
+   int h = st->ntaps - 1;                // history samples in use
+   int m = 0;
+   for(int a = 0; a < 4; a++) memcpy(x[a] - h, st->hist[a], h * sizeof(float));
+
+   for(int i = st->phase; i < n; i += st->decim, m++) {
+      for(int a = 0; a < 4; a++) {
+         const float *p = x[a] + i - h;
+         v4f acc = { 0, 0, 0, 0 };
+         for(int t = 0; t < st->ntaps; t += 4) {
+            v4f xv, tv;
+            memcpy(&xv, p + t, sizeof(v4f));     // unaligned load
+            memcpy(&tv, st->taps + t, sizeof(v4f));
+            acc += xv * tv;
+         }
+         out[a][m] = acc[0] + acc[1] + acc[2] + acc[3];
+      }
+      ts[m] = ts[i];
+   }
+   st->phase = (st->phase - n) % st->decim;
+   if(st->phase < 0) st->phase += st->decim;
+   for(int a = 0; a < 4; a++) memcpy(st->hist[a], x[a] + n - h, h * sizeof(float));
+   return(m);
+}
+
+/* ------------------------------------------------------------ *
+ * filt_batch() - window callback: convert the batch to float,  *
+ * run the chain, and pass each output sample to filt_out.      *
+ * ------------------------------------------------------------ */
+static void filt_batch(const struct bnowin *w, void *arg) {
+   int cur = 0, n = w->len;
+   float *x[4], *y[4];
+   float scale = ldexpf(1.0f, -w->q);
+
+   for(int a = 0; a < 4; a++) {
+      x[a] = &buf[cur][a][FILT_TAPS];
+      for(int i = 0; i < n; i++) x[a][i] = w->v[a][i] * scale;
+   }
+   memcpy(tsbuf[cur], w->ts, n * sizeof(uint32_t));
+
+   for(int s = 0; s < nstages && n > 0; s++) {
+      if(stage[s].type == FILT_IIR) {
+         n = run_iir(&stage[s], x, n);
+         continue;
+      }
+      for(int a = 0; a < 4; a++) y[a] = &buf[cur ^ 1][a][FILT_TAPS];
+      memcpy(tsbuf[cur ^ 1], tsbuf[cur], n * sizeof(uint32_t));
+      n = run_fir(&stage[s], x, n, y, tsbuf[cur ^ 1]);
+      cur ^= 1;
+      memcpy(x, y, sizeof(x));
+   }
+
+   struct bnosample smp;
+   float back = ldexpf(1.0f, w->q);
+   smp.repid = w->repid;
+   smp.q = w->q;
+   smp.acc = w->acc[w->len - 1];
+   smp.dev = 0;
+   for(int i = 0; i < n; i++) {
+      for(int a = 0; a < 4; a++) {
+         float v = roundf(x[a][i] * back);
+         smp.v[a] = (v > 32767) ? 32767 : (v < -32768) ? -32768 : v;
+      }
+      smp.ts = tsbuf[cur][i];
+      filt_out(&smp, filt_arg);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * filt_start() - feed report repid through the filter chain,   *
+ * filtered samples are passed to out(smp, arg).                *
+ * ------------------------------------------------------------ */
+int filt_start(uint8_t repid, void (*out)(struct bnosample*, void*), void *arg) {
+   filt_out = out;
+   filt_arg = arg;
+   // close on FILT_BATCH samples, or 4 periods late if samples drop
+   uint32_t span = (uint32_t) (FILT_BATCH * 1000000.0f / in_hz);
+   if(win_init(&filt_win, repid, span + 4000000 / in_hz, FILT_BATCH, filt_batch, NULL) != 0)
+      return(-1);
+   return(win_add(&filt_win));
+}
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <getopt.h>
 #include <time.h>
+#include <sys/epoll.h>
 #include "getbno080.h"
 
 /* ------------------------------------------------------------ *
@@ -35,16 +36,75 @@ char senaddr[256] = "0x4b";
 char i2c_bus[256] = I2CBUS;
 char htmfile[256];
 char calfile[256];
+uint32_t interval = REPORT_INTERVAL; // report interval in usecs
+int samples = 1;                     // samples to read, 0 = endless
+uint32_t rate_min = 0;               // adaptive rate bounds in usecs,
+uint32_t rate_max = 0;               // 0 = adaptive control disabled
+char sinkspec[256];                  // streaming output fmt[:file]
+char jsnfile[256];                   // JSON snapshot file
+int snap_ms = 0;                     // snapshot period, 0 = single run
+int statsflag = 0;                   // print statistics at exit
+char statsfile[256];                 // JSON statistics dump file
+char calbackup[256];                 // DCD host backup, autosave
+int win_ms = 0;                      // analysis window, 0 = off
+char filtspec[256];                  // host filter chain, see --filter
+int duty_n = 0;                      // samples per duty cycle burst
+uint32_t duty_ms = 0;                // duty cycle period, 0 = off
+int latflag = 0;                     // print sample age table at exit
+char promfile[256];                  // Prometheus textfile metrics
+float sync_hz = 0;                   // --sync frame rate, 0 = off
+char resampspec[256];                // --resample hz[:lookahead msec]
+char wdspec[256];                    // --watchdog frac[:deadline msec]
+char scriptfile[256];                // -s command script, - = stdin
+int evflag = 0;                      // --events wake event mode
+
+/* ------------------------------------------------------------ *
+ * Long-only options get values outside the short option range  *
+ * ------------------------------------------------------------ */
+enum {
+   OPT_STATS = 256,
+   OPT_STATSFILE,
+   OPT_CALFILE,
+   OPT_WINDOW,
+   OPT_FILTER,
+   OPT_DUTY,
+   OPT_LATENCY,
+   OPT_METRICS,
+   OPT_SYNC,
+   OPT_RESAMPLE,
+   OPT_WATCHDOG,
+   OPT_EVENTS
+};
+static struct option long_opts[] = {
+   { "stats",      no_argument,       NULL, OPT_STATS },
+   { "stats-file", required_argument, NULL, OPT_STATSFILE },
+   { "cal-file",   required_argument, NULL, OPT_CALFILE },
+   { "window",     required_argument, NULL, OPT_WINDOW },
+   { "filter",     required_argument, NULL, OPT_FILTER },
+   { "duty",       required_argument, NULL, OPT_DUTY },
+   { "latency",    no_argument,       NULL, OPT_LATENCY },
+   { "metrics",    required_argument, NULL, OPT_METRICS },
+   { "sync",       required_argument, NULL, OPT_SYNC },
+   { "resample",   required_argument, NULL, OPT_RESAMPLE },
+   { "watchdog",   required_argument, NULL, OPT_WATCHDOG },
+   { "events",     no_argument,       NULL, OPT_EVENTS },
+   { NULL, 0, NULL, 0 }
+};
 
 /* ------------------------------------------------------------ *
  * print_usage() prints the programs commandline instructions.  *
  * ------------------------------------------------------------ */
 void usage() {
-   static char const usage[] = "Usage: getbno080 [-a hex i2c-addr] [-m <opr_mode>] [-t acc|gyr|mag|eul|qua|lin|gra|inf|cal] [-r] [-w calfile] [-l calfile] [-o htmlfile] [-v]\n\
+   static char const usage[] = "Usage: getbno080 [-a hex i2c-addr] [-m <opr_mode>] [-t acc|gyr|mag|eul|qua|gir|lin|gra|inf|cal] [-i usec] [-n count] [-x min:max] [-f fmt[:file]] [-r] [-w calfile] [-l calfile] [-o htmlfile] [-j jsonfile] [-u msec] [-s script] [--stats] [--stats-file file] [--cal-file file] [--window msec] [--filter spec] [--duty count:msec] [--latency] [--metrics file] [--sync hz] [--resample hz[:msec]] [--watchdog frac[:msec]] [--events] [-v]\n\
 \n\
 Command line parameters have the following format:\n\
    -a   sensor I2C bus address in hex, Example: -a 0x4a (default: 0x4b)\n\
    -b   I2C bus to query, Example: -b /dev/i2c-1 (default)\n\
+        A comma separated list of up to 4 buses, each with an optional\n\
+        @address, reads one sensor per bus in parallel and merges the\n\
+        samples by time. Output records get the bus index (dev) added.\n\
+        Streams -t acc|gyr|mag|lin|qua with -i, -n and -f only.\n\
+        Example: -b /dev/i2c-1,/dev/i2c-3@0x4a -t qua -n 0 -f csv\n\
    -c   send tare calibration command. mode arguments:\n\
            rota     = use rotation vector\n\
            game     = use gaming rotation vector\n\
@@ -56,32 +116,108 @@ Command line parameters have the following format:\n\
    -d   dump the complete sensor register map content\n\
    -p   set sensor power mode. mode arguments:\n\
           normal    = required sensors and MCU always on (default)\n\
-          low       = enter sleep mode during motion inactivity\n\
-          suspend   = sensor paused, all parts put to sleep\n\
+          low       = hub sleeps, only wake-up reports keep running\n\
+          suspend   = all reports turned off, hub sleeps. A new process asks\n\
+                      the hub which reports run. low and suspend can't be\n\
+                      used with -t, see --duty for low power streaming\n\
    -r   reset sensor\n\
    -t   read and output sensor data. data type arguments:\n\
            acc = Accelerometer (X-Y-Z axis values)\n\
            gyr = Gyroscope (X-Y-Z axis values)\n\
            mag = Magnetometer (X-Y-Z axis values)\n\
            qua = Orientation Q (W-X-Y-Z values as Quaternation)\n\
+           gir = Gyro-integrated rotation vector, channel 5 fast lane\n\
            inf = Sensor info (SW version and state values)\n\
            cal = Calibration data (mag, gyro and accel calibration values)\n\
-   -l   enable calibration for all sensor modules\n\
-   -w   stop calibration, and write calibration data to flash\n\
+   -i   sensor report interval in microseconds (default: 60000)\n\
+   -n   number of samples to read, 0 reads continuously (default: 1)\n\
+   -x   adaptive report rate, interval bounds in microseconds. The interval\n\
+        follows the stability classifier: -i rate during motion, slowing\n\
+        down to max while at rest. With -f, the motion rate also halves\n\
+        while the output reader can't keep up. Example: -x 2500:200000\n\
+   -f   stream samples in a buffered output format, to stdout or a file:\n\
+           csv   = comma separated values with a header line\n\
+           jsonl = one JSON object per line\n\
+           bin   = packed 16-byte binary samples (struct bnosample)\n\
+        Example: -f csv:/tmp/acc.csv, requires -t acc|gyr|mag|lin|qua\n\
+   -l   load the dynamic calibration data (DCD) from file into the sensor\n\
+        and reset it, the fusion starts calibrated. Example: -l ./bno080.cal\n\
+   -w   save the sensor DCD to flash, and write it to file\n\
    -o   output sensor data to HTML table file, requires -t, Example: -o ./bno080.html\n\
+   -j   output sensor data to JSON file, requires -t and -u\n\
+   -u   keep running and rewrite the -o/-j snapshot files every msec\n\
+        milliseconds. Files are replaced atomically. Example: -u 500\n\
+   -s   run a command script in one session, - reads stdin. One op per\n\
+        line, each step writes a JSON line with status and duration:\n\
+           info, calstat, feature <rep> <usec>, read <rep> <count>,\n\
+           frs-read <hex>, frs-write <hex> <hexword>.., save-cal <file>,\n\
+           load-cal <file>, reset, power normal|low|suspend, sleep <msec>\n\
+        <rep> is a report name: acc, gyr, mag, lin, qua, gam, sta, ...\n\
+        read enables a report that is off at the -i interval\n\
+   --stats       print transaction latency and packet statistics at exit.\n\
+                 SIGUSR1 prints them to stderr while running.\n\
+   --stats-file  write the statistics as JSON to file at exit and SIGUSR1\n\
+   --cal-file    DCD backup file: restored at start if it exists and differs\n\
+                 from the sensor flash, calibration and periodic DCD save\n\
+                 enabled, rewritten while streaming each time the report\n\
+                 accuracy reaches high\n\
+   --window      collect samples in msec windows and print mean, min and\n\
+                 max per axis for each window instead of every sample.\n\
+                 With -f, the window lines go to stderr\n\
+   --filter      filter chain for the sample stream, comma separated stages:\n\
+                    lp:hz  = 2nd order Butterworth low-pass at hz\n\
+                    ma:n   = moving average over n samples\n\
+                    fir:m  = FIR low-pass, keeps every m-th sample\n\
+                 Requires a fixed -i rate. Example: --filter lp:40,fir:4\n\
+   --duty        duty-cycled acquisition: wake the hub, read count samples,\n\
+                 then sleep it until the next msec period starts. The wake\n\
+                 to first sample latency is in --stats. Example: --duty 20:5000\n\
+   --latency     print the sample age percentiles per report at exit: from\n\
+                 the hub sample time to I2C read done, decode done and output\n\
+                 done. Uses the report timestamps, the hub to host interrupt\n\
+                 time is not included\n\
+   --metrics     write counters in Prometheus text format to file every 5s\n\
+                 while streaming, for the node exporter textfile collector.\n\
+                 Example: --metrics /var/lib/node_exporter/bno080.prom\n\
+   --sync        with a -b bus list, resample all sensors to one hz tick and\n\
+                 output one frame per tick with the values of every bus.\n\
+                 Vectors are interpolated linearly, quaternions by SLERP.\n\
+                 -n counts the samples read.\n\
+                 Example: -b /dev/i2c-1,/dev/i2c-3 -t qua --sync 100\n\
+   --resample    put out -t qua at a fixed hz rate, interpolated by nlerp.\n\
+                 A tick waits up to msec for the next sample (default 20),\n\
+                 then holds the last one. --stats adds the interpolation\n\
+                 error. -n counts the samples read. Example: --resample 250:10\n\
+   --watchdog    alarm if a streamed report drops below frac of its set rate,\n\
+                 or stays silent for msec (default 250), then run the error\n\
+                 recovery. Alarms show in --stats and --metrics.\n\
+                 Example: --watchdog 0.5:200\n\
+   --events      event-only low power mode: tap, step counter, stability and\n\
+                 activity run as wake reports, the hub sleeps in between.\n\
+                 Each burst of wake reports is printed as one event line.\n\
+                 -i limits the report rate, -n counts the events\n\
    -h   display this message\n\
-   -v   enable debug output\n\
+   -v   enable debug output, the SHTP packet trace is printed at exit.\n\
+        SIGUSR2 prints the last 4096 packet events to stderr any time.\n\
 \n\
 Usage examples:\n\
 ./getbno080 -a 0x4b -t inf -v\n\
 ./getbno080 -t acc -v\n\
+./getbno080 -t acc -i 2500 -n 0 -x 2500:200000\n\
+./getbno080 -t gyr -i 2500 -n 0 -f jsonl\n\
+./getbno080 -t acc -i 2500 -n 0 -f csv --filter lp:50,fir:8\n\
 ./getbno080 -t eul -o ./bno080.html\n\
+./getbno080 -t acc -i 10000 -o ./bno080.html -j ./bno080.json -u 500\n\
+./getbno080 -t acc -n 0 -f csv --cal-file ./bno080.cal\n\
+./getbno080 -t acc -i 10000 -n 0 -f csv --duty 10:60000 --stats\n\
+printf 'info\\nread acc 10\\nreset\\n' | ./getbno080 -s -\n\
+./getbno080 --events -n 0 -i 100000\n\
 ./getbno080 -r\n";
    printf(usage);
 }
 
 /* ------------------------------------------------------------ *
- * parseargs() checks the commandline arguments with C getopt   *
+ * parseargs() checks the cmdline arguments with getopt_long()  *
  * ------------------------------------------------------------ */
 void parseargs(int argc, char* argv[]) {
    int arg;
@@ -89,7 +225,8 @@ void parseargs(int argc, char* argv[]) {
 
    if(argc == 1) { usage(); exit(-1); }
 
-   while ((arg = (int) getopt (argc, argv, "a:dm:p:rt:l:w:o:hv")) != -1) {
+   while ((arg = (int) getopt_long(argc, argv, "a:b:df:i:j:m:n:p:rs:t:l:w:o:u:x:hv",
+                                     long_opts, NULL)) != -1) {
       switch (arg) {
          // arg -v verbose, type: flag, optional
          case 'v':
@@ -107,7 +244,8 @@ void parseargs(int argc, char* argv[]) {
             break;
 
          // arg -b + I2C bus, type: string
-         // optional, example: "/dev/i2c-1"
+         // optional, example: "/dev/i2c-1", or a bus list
+         // "/dev/i2c-1,/dev/i2c-3@0x4a" for multi-bus mode
          case 'b':
             if(verbose == 1) printf("Debug: arg -b, value %s\n", optarg);
             if (strlen(optarg) >= sizeof(i2c_bus)) {
@@ -124,6 +262,46 @@ void parseargs(int argc, char* argv[]) {
             argflag = 1;
             break;
 
+         // arg -i + report interval in usecs, type: int
+         // optional, example: 2500 (400Hz)
+         case 'i':
+            if(verbose == 1) printf("Debug: arg -i, value %s\n", optarg);
+            interval = strtoul(optarg, NULL, 10);
+            if(interval == 0) {
+               printf("Error: Cannot get valid -i interval argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg -f + output format and optional file, type: string
+         // optional, example: csv:/tmp/acc.csv
+         case 'f':
+            if(verbose == 1) printf("Debug: arg -f, value %s\n", optarg);
+            if (strlen(optarg) >= sizeof(sinkspec)) {
+               printf("Error: invalid -f output argument.\n");
+               exit(-1);
+            }
+            strncpy(sinkspec, optarg, sizeof(sinkspec));
+            break;
+
+         // arg -n + sample count, type: int
+         // optional, 0 reads continuously
+         case 'n':
+            if(verbose == 1) printf("Debug: arg -n, value %s\n", optarg);
+            samples = atoi(optarg);
+            break;
+
+         // arg -x + min:max interval bounds in usecs, type: string
+         // optional, enables the adaptive report rate controller
+         case 'x':
+            if(verbose == 1) printf("Debug: arg -x, value %s\n", optarg);
+            if(sscanf(optarg, "%u:%u", &rate_min, &rate_max) != 2
+               || rate_min == 0 || rate_max < rate_min) {
+               printf("Error: Cannot get valid -x min:max argument.\n");
+               exit(-1);
+            }
+            break;
+
          // arg -m sets operations mode, type: string
          case 'm':
             if(verbose == 1) printf("Debug: arg -m, value %s\n", optarg);
@@ -154,6 +332,17 @@ void parseargs(int argc, char* argv[]) {
             strncpy(datatype, optarg, sizeof(datatype));
             break;
 
+         // arg -s + command script file, type: string
+         // runs the script in one session, example: ./provision.txt
+         case 's':
+            if(verbose == 1) printf("Debug: arg -s, value %s\n", optarg);
+            if(strlen(optarg) >= sizeof(scriptfile)) {
+               printf("Error: invalid -s script argument.\n");
+               exit(-1);
+            }
+            strncpy(scriptfile, optarg, sizeof(scriptfile));
+            break;
+
          // arg -l + calibration file name, type: string
          // loads the sensor calibration from file. example: ./bno080.cal
          case 'l':
@@ -178,6 +367,126 @@ void parseargs(int argc, char* argv[]) {
             strncpy(htmfile, optarg, sizeof(htmfile));
             break;
 
+         // arg -j + dst JSON file, type: string, requires -t -u
+         // writes the sensor snapshot to file. example: /tmp/sensor.json
+         case 'j':
+            if(verbose == 1) printf("Debug: arg -j, value %s\n", optarg);
+            strncpy(jsnfile, optarg, sizeof(jsnfile)-1);
+            break;
+
+         // arg -u + snapshot period in msecs, type: int
+         // optional, rewrites -o/-j every period until stopped
+         case 'u':
+            if(verbose == 1) printf("Debug: arg -u, value %s\n", optarg);
+            snap_ms = atoi(optarg);
+            if(snap_ms <= 0) {
+               printf("Error: Cannot get valid -u period argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg --stats, type: flag, optional
+         case OPT_STATS:
+            statsflag = 1;
+            break;
+
+         // arg --stats-file + JSON dump file, type: string
+         // optional, example: /tmp/bno080-stats.json
+         case OPT_STATSFILE:
+            if(verbose == 1) printf("Debug: arg --stats-file, value %s\n", optarg);
+            strncpy(statsfile, optarg, sizeof(statsfile)-1);
+            break;
+
+         // arg --window + window length in msecs, type: int
+         // optional, example: 1000
+         case OPT_WINDOW:
+            if(verbose == 1) printf("Debug: arg --window, value %s\n", optarg);
+            win_ms = atoi(optarg);
+            if(win_ms <= 0) {
+               printf("Error: Cannot get valid --window argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg --filter + filter chain, type: string
+         // optional, example: lp:40,fir:4
+         case OPT_FILTER:
+            if(verbose == 1) printf("Debug: arg --filter, value %s\n", optarg);
+            if(strlen(optarg) >= sizeof(filtspec)) {
+               printf("Error: invalid --filter argument.\n");
+               exit(-1);
+            }
+            strncpy(filtspec, optarg, sizeof(filtspec));
+            break;
+
+         // arg --latency, type: flag, optional
+         case OPT_LATENCY:
+            latflag = 1;
+            break;
+
+         // arg --metrics + Prometheus textfile, type: string
+         // optional, example: /var/lib/node_exporter/bno080.prom
+         case OPT_METRICS:
+            if(verbose == 1) printf("Debug: arg --metrics, value %s\n", optarg);
+            strncpy(promfile, optarg, sizeof(promfile)-1);
+            break;
+
+         // arg --sync + frame rate in Hz, type: float
+         // optional, example: 100
+         case OPT_SYNC:
+            if(verbose == 1) printf("Debug: arg --sync, value %s\n", optarg);
+            sync_hz = atof(optarg);
+            if(sync_hz <= 0) {
+               printf("Error: Cannot get valid --sync argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg --resample + rate in Hz and lookahead in msecs, type: string
+         // optional, example: 250:10
+         case OPT_RESAMPLE:
+            if(verbose == 1) printf("Debug: arg --resample, value %s\n", optarg);
+            if(strlen(optarg) >= sizeof(resampspec)) {
+               printf("Error: invalid --resample argument.\n");
+               exit(-1);
+            }
+            strncpy(resampspec, optarg, sizeof(resampspec));
+            break;
+
+         // arg --watchdog + rate fraction and deadline in msecs, type: string
+         // optional, example: 0.5:200
+         case OPT_WATCHDOG:
+            if(verbose == 1) printf("Debug: arg --watchdog, value %s\n", optarg);
+            if(strlen(optarg) >= sizeof(wdspec)) {
+               printf("Error: invalid --watchdog argument.\n");
+               exit(-1);
+            }
+            strncpy(wdspec, optarg, sizeof(wdspec));
+            break;
+
+         // arg --events, type: flag, optional
+         case OPT_EVENTS:
+            evflag = 1;
+            break;
+
+         // arg --duty + burst count and period in msecs, type: string
+         // optional, example: 20:5000
+         case OPT_DUTY:
+            if(verbose == 1) printf("Debug: arg --duty, value %s\n", optarg);
+            if(sscanf(optarg, "%d:%u", &duty_n, &duty_ms) != 2
+               || duty_n <= 0 || duty_ms == 0) {
+               printf("Error: Cannot get valid --duty count:msec argument.\n");
+               exit(-1);
+            }
+            break;
+
+         // arg --cal-file + DCD backup file, type: string
+         // optional, example: ./bno080.cal
+         case OPT_CALFILE:
+            if(verbose == 1) printf("Debug: arg --cal-file, value %s\n", optarg);
+            strncpy(calbackup, optarg, sizeof(calbackup)-1);
+            break;
+
          // arg -h usage, type: flag, optional
          case 'h':
             usage(); exit(0);
@@ -199,19 +508,325 @@ void parseargs(int argc, char* argv[]) {
    }
 }
 
+/* ------------------------------------------------------------ *
+ * stream_repid() returns the report ID for a -t data type that *
+ * can be streamed, or 0 if the type has no input report.       *
+ * ------------------------------------------------------------ */
+int stream_repid(char *type) {
+   if(strcmp(type, "acc") == 0) return(SENSOR_REPORTID_ACC);
+   if(strcmp(type, "gyr") == 0) return(SENSOR_REPORTID_GYR);
+   if(strcmp(type, "mag") == 0) return(SENSOR_REPORTID_MAG);
+   if(strcmp(type, "lin") == 0) return(SENSOR_REPORTID_LIN);
+   if(strcmp(type, "qua") == 0) return(SENSOR_REPORTID_ROT);
+   if(strcmp(type, "gir") == 0) return(SENSOR_REPORTID_GIR);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * emit_sample() outputs one sample to the -u snapshot and the  *
+ * -f sink, or as a text line to stdout. Called per sample, or  *
+ * per filtered sample with --filter. A sink error is kept in   *
+ * snk_err and ends the stream.                                 *
+ * ------------------------------------------------------------ */
+static struct sink snk;
+static int snk_err = 0;
+
+static void emit_sample(struct bnosample *smp, void *arg) {
+   prom_sample(smp->repid);
+   if(snap_ms > 0) snap_update(smp);
+   if(sinkspec[0] != '\0') {
+      if(sink_write(&snk, smp) != 0) snk_err = 1;
+   }
+   else if(snap_ms == 0 && win_ms == 0) { // -u, --window: no console lines
+      float val[4];
+      if(snk.devcol) printf("%d ", smp->dev);
+      if(sample_float(smp, val) == 4)
+         printf("%s %3.4f %3.4f %3.4f %3.4f\n", datatype,
+                 val[0], val[1], val[2], val[3]);
+      else
+         printf("%s %3.2f %3.2f %3.2f\n", datatype,
+                 val[0], val[1], val[2]);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * emit_frame() outputs one --sync frame to the -f sink, or as  *
+ * a text line with the values of each bus, "-" if missing.     *
+ * ------------------------------------------------------------ */
+static void emit_frame(struct bnoframe *frm, void *arg) {
+   if(sinkspec[0] != '\0') {
+      if(sink_frame(&snk, frm) != 0) snk_err = 1;
+      return;
+   }
+   int count = FRAME_COUNT(frm);
+   float scale = 1.0f / (1 << frm->q);
+   printf("%s %u", datatype, frm->ts);
+   for(int d = 0; d < frm->ndev; d++) {
+      for(int i = 0; i < count; i++) {
+         if(frm->mask & (1 << d)) printf(" %3.4f", frm->v[d][i] * scale);
+         else printf(" -");
+      }
+   }
+   printf("\n");
+}
+
+/* ------------------------------------------------------------ *
+ * stream_reports() enables report repid at the -i interval and *
+ * outputs -n samples (0 = endless), optionally under adaptive  *
+ * rate control (-x). Output goes through the -f sink, or as    *
+ * one text line per sample to stdout. With --filter, -n counts *
+ * the raw samples going into the filter chain.                 *
+ * ------------------------------------------------------------ */
+int stream_reports(int repid) {
+   static struct bnowin win;
+   static struct bnocmd resync;          // deferred feature re-issue
+   struct ratectl rctl;
+   struct bnosample smp;
+   int res;
+
+   if(sinkspec[0] != '\0' && sink_open(&snk, sinkspec) != 0) return(-1);
+   if(win_ms > 0) {
+      // room for a full window at the fastest possible rate
+      uint32_t fastest = (rate_max > 0) ? rate_min : interval;
+      uint64_t span = win_ms * 1000ULL;
+      FILE *fp = (sinkspec[0] != '\0') ? stderr : stdout;
+      if(span > UINT32_MAX || span / fastest + 1 > INT32_MAX) {
+         printf("Error: --window %d ms is too long for %u us reports.\n", win_ms, fastest);
+         return(-1);
+      }
+      if(win_init(&win, repid, span, span / fastest + 1, win_print, fp) != 0) return(-1);
+      win_add(&win);
+   }
+   if(filtspec[0] != '\0') {
+      if(rate_max > 0) {
+         printf("Error: --filter requires a fixed rate, cannot use -x.\n");
+         return(-1);
+      }
+      if(filt_parse(filtspec, 1000000.0f / interval) != 0) return(-1);
+      if(filt_start(repid, emit_sample, NULL) != 0) return(-1);
+   }
+   if(resampspec[0] != '\0') {
+      if(repid != SENSOR_REPORTID_ROT || filtspec[0] != '\0') {
+         printf("Error: --resample requires -t qua, and cannot use --filter.\n");
+         return(-1);
+      }
+      if(resamp_parse(resampspec) != 0) return(-1);
+      resamp_start(emit_sample, NULL);
+   }
+
+   if(rate_max > 0) res = ratectl_init(&rctl, repid, rate_min, rate_max, interval);
+   else res = set_feature(repid, interval);
+   if(res != 0) {
+      printf("Error: Cannot enable sensor report [%02X].\n", repid);
+      return(-1);
+   }
+
+   if(wdspec[0] != '\0') {
+      if(duty_ms > 0) {
+         printf("Error: --watchdog cannot watch a --duty cycled stream.\n");
+         return(-1);
+      }
+      if(wd_parse(wdspec) != 0 || wd_start() != 0) return(-1);
+   }
+
+   prom_start(promfile);
+   int count = 0, burst = 0, cycles = 0;
+   uint64_t cycle = stats_now();         // --duty period start
+   uint64_t wake = 0;                    // --duty wake time, 0 = awake
+   while((samples == 0 || count < samples) && snk_err == 0) {
+      stats_poll(statsfile);
+      trace_poll();
+      prom_poll(snk.len);
+      if(stats.resync) {
+         /* ----------------------------------------------------- *
+          * Too many sequence errors: re-baseline the sequence    *
+          * tracking and re-issue the feature at its current rate *
+          * through the scheduler, between the incoming reports   *
+          * ----------------------------------------------------- */
+         if(verbose == 1) printf("Debug: Sequence errors, resync report [%02X]\n", repid);
+         stats_seq_reset();
+         stats.resyncs++;
+         if(resync.state != CMD_PENDING) {
+            feature_request(&resync, repid, (rate_max > 0) ? rctl.cur_us : interval);
+            sched_defer(&resync);
+         }
+      }
+      if(wd_tripped()) {
+         // stalled or slow report: reset the hub, restore the features
+         if(verbose == 1) printf("Debug: Watchdog alarm, recover report [%02X]\n", repid);
+         bno_recover(ERR_TIMEOUT);
+      }
+      int rid = get_report();
+      if(rid == SENSOR_REPORTID_STA && rate_max > 0) ratectl_update(&rctl);
+      if(rid != repid) {
+         if(resampspec[0] != '\0') resamp_poll(sink_clock());
+         if(rid == 0) usleep(I2CDELAY);  // more reports of the packet may follow
+         continue;
+      }
+      if(wake != 0) {
+         stats_op(OP_WAKE, wake);        // wake to first sample latency
+         wake = 0;
+      }
+      report_sample(&smp, rid);
+      if(calbackup[0] != '\0') cal_poll(smp.acc);
+      // windows and the filter chain both take raw samples
+      if(win_ms > 0 || filtspec[0] != '\0') win_feed(&smp);
+      if(resampspec[0] != '\0') {
+         // interpolate on the hub sample time, not the host read time
+         if(reptime.age > 0) smp.ts -= reptime.age;
+         resamp_sample(&smp, NULL);
+      }
+      else if(filtspec[0] == '\0') emit_sample(&smp, NULL);
+      if(latflag == 1) lat_add(rid, stats_now());
+      if(rate_max > 0 && sinkspec[0] != '\0') ratectl_sink(&rctl, &snk);
+      count++;
+
+      if(duty_ms > 0 && ++burst == duty_n && (samples == 0 || count < samples)) {
+         /* ----------------------------------------------------- *
+          * Burst complete: flush the output, then the hub sleeps *
+          * until the next period. Non-wake reports stop while    *
+          * the hub sleeps and resume at their interval after.    *
+          * ----------------------------------------------------- */
+         if(sinkspec[0] != '\0' && sink_flush(&snk) != 0) return(-1);
+         fflush(stdout);
+         burst = 0;
+         cycles++;
+         if((wake = pwr_cycle(&cycle, duty_ms)) == 0) {
+            printf("Error: Cannot duty cycle the sensor power.\n");
+            return(-1);
+         }
+      }
+   }
+
+   if(rate_max > 0 && verbose == 1)
+      printf("Debug: %d report rate changes, now %u us\n", rctl.changes, rctl.cur_us);
+   if(duty_ms > 0 && verbose == 1)
+      printf("Debug: %d duty cycles of %d samples every %u ms\n", cycles, duty_n, duty_ms);
+   if(calbackup[0] != '\0') cal_stop();
+   if(win_ms > 0 || filtspec[0] != '\0') win_flush();
+   prom_stop(snk.len);                   // last textfile keeps the watchdog alarms
+   wd_stop();
+   if(snk_err != 0) return(-1);
+   if(sinkspec[0] != '\0') return(sink_close(&snk));
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * stream_events() runs the --events mode and prints -n events  *
+ * (0 = endless). The poller thread owns the bus, this thread   *
+ * sleeps in epoll on its eventfd until events are queued, or   *
+ * at most a second, then checks the poller is still running.   *
+ * ------------------------------------------------------------ */
+int stream_events() {
+   struct epoll_event ee = { .events = EPOLLIN };
+   struct bnoevent e;
+   uint64_t n;
+   int count = 0, res = 0;
+
+   int fd = ev_start(i2c_bus, senaddr, interval, statsfile);
+   if(fd < 0) return(-1);
+   int ep = epoll_create1(EPOLL_CLOEXEC);
+   if(ep < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ee) != 0) {
+      printf("Error: Cannot wait on the event fd.\n");
+      ev_stop();
+      return(-1);
+   }
+
+   while(samples == 0 || count < samples) {
+      int up = ev_alive();               // events queued before its end still print
+      if(epoll_wait(ep, &ee, 1, 1000) == 1 && read(fd, &n, sizeof(n)) != sizeof(n)) continue;
+      while((samples == 0 || count < samples) && ev_take(&e)) {
+         printf("evt %u", e.ts);
+         if(e.mask & EV_TAP) printf(" tap=%02X", e.tap);
+         if(e.mask & EV_STEP) printf(" steps=%u", e.steps);
+         if(e.mask & EV_STABILITY) printf(" stability=%u", e.stability);
+         if(e.mask & EV_ACTIVITY) printf(" activity=%u", e.activity);
+         printf(" reports=%u span=%u\n", e.reports, e.span);
+         count++;
+      }
+      fflush(stdout);
+      if(up == 0) {
+         printf("Error: The event poller has ended.\n");
+         res = -1;
+         break;
+      }
+   }
+   close(ep);
+   ev_stop();
+   return(res);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_exit() prints the -v packet trace, the statistics, the *
+ * --latency tables, the --resample error, the --watchdog       *
+ * alarms, the receive scheduler queues and the --events poller *
+ * counters, runs at exit()                                     *
+ * ------------------------------------------------------------ */
+void stats_exit() {
+   if(verbose == 1) trace_dump(stdout);
+   if(statsflag == 1) stats_print(stdout);
+   if(latflag == 1) lat_print(stdout);
+   if(latflag == 1) fast_print(stdout);
+   if(statsflag == 1 && resampspec[0] != '\0') resamp_print(stdout);
+   if(statsflag == 1 && wdspec[0] != '\0') wd_print(stdout);
+   if(statsflag == 1) sched_print(stdout);
+   if(statsflag == 1 && evflag == 1) ev_print(stdout);
+   if(statsfile[0] != '\0') stats_dump(statsfile);
+}
+
 int main(int argc, char *argv[]) {
    /* ---------------------------------------------------------- *
     * Process the cmdline parameters                             *
     * ---------------------------------------------------------- */
    parseargs(argc, argv);
    int res = 0;
-   //rotationVector_Q1 = 14;
-   //accelerometer_Q1 = 8;
-   //linear_accelerometer_Q1 = 8;
-   //gyro_Q1 = 9;
-   //magnetometer_Q1 = 4;
+   stats_init(i2c_bus, senaddr);
+   trace_init();
+   atexit(stats_exit);
+   report_qinit();
    cmdsequence = 0;
 
+   /* ----------------------------------------------------------- *
+    * "--events" polls the wake reports on its own thread         *
+    * ----------------------------------------------------------- */
+   if(evflag == 1) {
+      if(datatype[0] != '\0' || argflag != 0 || pwr_mode[0] != '\0' || strchr(i2c_bus, ',') != NULL) {
+         printf("Error: --events cannot be used with -t, -p, -r, -d, -l, -w or a bus list.\n");
+         exit(-1);
+      }
+      exit(stream_events());
+   }
+
+   /* ----------------------------------------------------------- *
+    * "-b" with a bus list streams from all buses, merged by time *
+    * ----------------------------------------------------------- */
+   if(sync_hz > 0 && strchr(i2c_bus, ',') == NULL) {
+      printf("Error: --sync requires a -b bus list.\n");
+      exit(-1);
+   }
+   if(strchr(i2c_bus, ',') != NULL) {
+      int repid = stream_repid(datatype);
+      // one fast lane mailbox, it has a single writer
+      if(repid == 0 || repid == SENSOR_REPORTID_GIR || argflag != 0 || pwr_mode[0] != '\0' || rate_max > 0
+         || snap_ms > 0 || win_ms > 0 || filtspec[0] != '\0' || duty_ms > 0
+         || calbackup[0] != '\0' || latflag == 1 || promfile[0] != '\0' || wdspec[0] != '\0') {
+         printf("Error: a -b bus list requires -t acc|gyr|mag|lin|qua, with -i, -n and -f only.\n");
+         exit(-1);
+      }
+      int ndev = multi_parse(i2c_bus, senaddr);
+      if(ndev < 0) exit(-1);
+      snk.devcol = 1;
+      if(sync_hz > 0) {
+         if(sync_start(ndev, sync_hz, emit_frame, NULL) != 0) exit(-1);
+         snk.frames = ndev;
+      }
+      if(sinkspec[0] != '\0' && sink_open(&snk, sinkspec) != 0) exit(-1);
+      res = multi_stream(repid, interval, samples,
+                         (sync_hz > 0) ? sync_sample : emit_sample, NULL);
+      if(sinkspec[0] != '\0' && sink_close(&snk) != 0) res = -1;
+      exit(res);
+   }
+
    /* ----------------------------------------------------------- *
     * get current time (now), write program start if verbose      *
     * ----------------------------------------------------------- */
@@ -227,19 +842,92 @@ int main(int argc, char *argv[]) {
    sequence[3] = 0;
    sequence[4] = 0;
    sequence[5] = 0;
-   shtp_init(i2c_bus, senaddr);
+   if(shtp_init(i2c_bus, senaddr) != 0) exit(-1);
+
+   /* ----------------------------------------------------------- *
+    *  "-s" runs the command script on this session and exits     *
+    * ----------------------------------------------------------- */
+   if(scriptfile[0] != '\0') exit(script_run(scriptfile, interval) == 0 ? 0 : -1);
 
    /* ----------------------------------------------------------- *
     *  "-r" reset the sensor and exit the program                 *
     * ----------------------------------------------------------- */
    if(argflag == 2) {
-      bno_reset();
+      if(bno_reset() != 0) exit(-1);
+      exit(0);
+   }
+
+   /* ----------------------------------------------------------- *
+    *  "-p" set the hub power mode, continue if -t was given      *
+    * ----------------------------------------------------------- */
+   if(pwr_mode[0] != '\0') {
+      power_t pmode;
+      if(strcmp(pwr_mode, "normal") == 0) pmode = normal;
+      else if(strcmp(pwr_mode, "low") == 0) pmode = low;
+      else if(strcmp(pwr_mode, "suspend") == 0) pmode = suspend;
+      else {
+         printf("Error: invalid power mode %s.\n", pwr_mode);
+         exit(-1);
+      }
+      // non-wake reports stop while the hub sleeps, -t would wait forever
+      if(pmode != normal && datatype[0] != '\0') {
+         printf("Error: -p %s stops the sensor reports, use -t with -p normal or --duty.\n", pwr_mode);
+         exit(-1);
+      }
+      if(set_power(pmode) != 0) exit(-1);
+      if(datatype[0] == '\0') exit(0);
+   }
+
+   /* ----------------------------------------------------------- *
+    *  "-w" save the calibration to file and exit the program     *
+    * ----------------------------------------------------------- */
+   if(argflag == 4) {
+      if(save_cal(calfile) != 0) exit(-1);
       exit(0);
    }
 
+   /* ----------------------------------------------------------- *
+    *  "-l" load the calibration, continue if -t was given        *
+    * ----------------------------------------------------------- */
+   if(argflag == 3) {
+      if(load_cal(calfile) != 0) exit(-1);
+      if(datatype[0] == '\0') exit(0);
+   }
+
+   /* ----------------------------------------------------------- *
+    *  "--cal-file" restores the DCD backup, enables autosave     *
+    * ----------------------------------------------------------- */
+   if(calbackup[0] != '\0' && cal_start(calbackup) != 0) exit(-1);
+
    /* ----------------------------------------------------------- *
     *  "-t acc " reads accelerometer data from the sensor.        *
     * ----------------------------------------------------------- */
+   /* ----------------------------------------------------------- *
+    *  -n, -x or -f stream the sensor reports of the -t data type  *
+    * ----------------------------------------------------------- */
+   int repid = stream_repid(datatype);
+   if(snap_ms > 0) {
+      /* -------------------------------------------------------- *
+       * -u keeps streaming, the snapshot thread writes the files *
+       * -------------------------------------------------------- */
+      if(repid == 0 || (outflag == 0 && jsnfile[0] == '\0')) {
+         printf("Error: -u requires -t acc|gyr|mag|lin|qua and -o or -j.\n");
+         exit(-1);
+      }
+      if(samples == 1) samples = 0;
+      if(snap_start(outflag ? htmfile : NULL, jsnfile, snap_ms) != 0) exit(-1);
+      res = stream_reports(repid);
+      snap_stop();
+      exit(res);
+   }
+   if(repid > 0 && (samples != 1 || rate_max > 0 || sinkspec[0] != '\0'
+                    || filtspec[0] != '\0' || duty_ms > 0 || latflag == 1
+                    || promfile[0] != '\0' || resampspec[0] != '\0'
+                    || wdspec[0] != '\0')) {
+      res = stream_reports(repid);
+      exit(res);
+   }
+
    if(strcmp(datatype, "acc") == 0) {
       struct bnoacc bnod;
       res = get_acc(&bnod);
@@ -279,40 +967,14 @@ int main(int argc, char *argv[]) {
     * ----------------------------------------------------------- */
    if(strcmp(datatype, "inf") == 0) {
       /* -------------------------------------------------- *
-       *  Get the sensors software version data             *
+       *  Get SW version data, calibration state, serial    *
+       *  number and SHTP error list in one request batch   *
        * -------------------------------------------------- */
       struct prodid prodlist[2];
-      res = get_prodid(prodlist);
-      if(res != 0) {
-         printf("Error: Cannot read SW version data.\n");
-         exit(-1);
-      }
-      /* ----------------------------------------------------- *
-       *  Get the sensors calibration state                    *
-       * ----------------------------------------------------- */
       struct bnocal bnoc;
-      res = get_calstat(&bnoc);
-      if(res != 0) {
-         printf("Error: Cannot read calibration state.\n");
-         exit(-1);
-      }
-      /* ----------------------------------------------------- *
-       *  Get the sensors serial number from flash             *
-       * ----------------------------------------------------- */
       double serial;
-      res = get_serial(&serial);
-      if(res != 0) {
-         printf("Error: Cannot read calibration state.\n");
-         exit(-1);
-      }
-      /* ----------------------------------------------------- *
-       *  Get the sensors SHTP error list                      *
-       * ----------------------------------------------------- */
-      res = get_shtp_errors();
-      if(res < 0) {
-         printf("Error: Cannot read error list.\n");
-         exit(-1);
-      }
+      res = get_info(prodlist, &bnoc, &serial);
+      if(res != 0) exit(-1);
 
       /* -------------------------------------------------- *
        * print the formatted output strings to stdout       *
@@ -1,16 +1,23 @@
 /* ------------------------------------------------------------ *
  * file:        getbno080.h                                     *
  * purpose:     header file for getbno080.c and i2c_bno080.c    *
+ *              and the other *_bno080.c program modules.       *
  *                                                              *
  * author:      05/04/2018 Frank4DD                             *
  * ------------------------------------------------------------ */
 #include <stdint.h>
+#include <stdio.h>
+#include <signal.h>
 // I2C device on old RPI and clones is 0, for RPI2 and up its 1
 #define I2CBUS               "/dev/i2c-0"
 // I2C packet read delay in microseconds
 #define I2CDELAY             200
 // Packets can be up to 32k.
 #define MAX_PACKET_SIZE      32762 
+// SHTP header bytes: length LSB, length MSB, channel, sequence
+#define SHTP_HEADER          4
+// Max cargo bytes we send in one packet, per channel TX buffer
+#define SHTP_TXMAX           1024
 // This is in words, we only care about the first 9 (Qs, range, etc)
 #define MAX_METADATA_SIZE    9
 // SHTP cmd channel: byte-0=command, byte-1=parameter, byte-n=parameter
@@ -25,6 +32,8 @@
 #define CHANNEL_WAKE_REPORTS 4
 // Gyro rotation vector in extra channel to allow prioritization
 #define CHANNEL_GYRO         5
+// Number of SHTP channels
+#define SHTP_CHANNELS        6
 // Control channel commands (BNO8X datasheet figure 1-30)
 #define COMMAND_RESPONSE     0xF1
 #define COMMAND_REQUEST      0xF2
@@ -33,8 +42,10 @@
 #define FRS_WRITE_RESPONSE   0xF5  // Flash Record System write response
 #define FRS__WRITE_DATA      0xF6  // Flash Record System write data
 #define FRS__WRITE_REQUEST   0xF7  // Flash Record System write request
+#define FRS_SERIAL           0x4B4B // FRS record type of the serial number
 #define PRODUCT_ID_RESPONSE  0xF8
 #define PRODUCT_ID_REQUEST   0xF9
+#define TIME_REBASE          0xFA  // timestamp rebase, inside report packets
 #define GET_TIME_REFERENCE   0xFB 
 #define GET_FEATURE_RESPONSE 0xFC
 #define SET_FEATURE_COMMAND  0xFD
@@ -47,48 +58,96 @@
 #define SENSOR_REPORTID_LIN 0x04 // Linear Acceleration
 #define SENSOR_REPORTID_ROT 0x05 // Rotation Vector
 #define SENSOR_REPORTID_GRA 0x06 // Gravity
+#define SENSOR_REPORTID_UGY 0x07 // Uncalibrated Gyroscope
 #define SENSOR_REPORTID_GAM 0x08 // Game Rotation Vector
 #define SENSOR_REPORTID_GEO 0x09 // Geomagnetic Rotation
+#define SENSOR_REPORTID_PRS 0x0A // Pressure
+#define SENSOR_REPORTID_ALS 0x0B // Ambient Light
+#define SENSOR_REPORTID_HUM 0x0C // Humidity
+#define SENSOR_REPORTID_PRX 0x0D // Proximity
+#define SENSOR_REPORTID_TMP 0x0E // Temperature
+#define SENSOR_REPORTID_UMG 0x0F // Uncalibrated Magnetometer
 #define SENSOR_REPORTID_TAP 0x10 // Tap Detector
 #define SENSOR_REPORTID_STP 0x11 // Step Counter
+#define SENSOR_REPORTID_SIG 0x12 // Significant Motion
 #define SENSOR_REPORTID_STA 0x13 // Stability Classifier
+#define SENSOR_REPORTID_RAC 0x14 // Raw Accelerometer
+#define SENSOR_REPORTID_RGY 0x15 // Raw Gyroscope
+#define SENSOR_REPORTID_RMG 0x16 // Raw Magnetometer
+#define SENSOR_REPORTID_SDT 0x18 // Step Detector
+#define SENSOR_REPORTID_SHK 0x19 // Shake Detector
+#define SENSOR_REPORTID_FLP 0x1A // Flip Detector
+#define SENSOR_REPORTID_PCK 0x1B // Pickup Detector
+#define SENSOR_REPORTID_SDE 0x1C // Stability Detector
 #define SENSOR_REPORTID_PER 0x1E // Personal Activity Classifier
+#define SENSOR_REPORTID_SLP 0x1F // Sleep Detector
+#define SENSOR_REPORTID_TLT 0x20 // Tilt Detector
+#define SENSOR_REPORTID_PKT 0x21 // Pocket Detector
+#define SENSOR_REPORTID_CIR 0x22 // Circle Detector
+#define SENSOR_REPORTID_HRM 0x23 // Heart Rate Monitor
+#define SENSOR_REPORTID_ARV 0x28 // ARVR-Stabilized Rotation Vector
+#define SENSOR_REPORTID_ARG 0x29 // ARVR-Stabilized Game Rotation Vector
+#define SENSOR_REPORTID_GIR 0x2A // Gyro-Integrated Rotation Vector
+#define SENSOR_REPORTID_MRQ 0x2B // Motion Request
+// Default report interval in microseconds (0xEA60 = 60ms)
+#define REPORT_INTERVAL      60000
+// Stability classifier values, SH-2 reference manual 6.5.31
+#define STABILITY_UNKNOWN    0
+#define STABILITY_ONTABLE    1
+#define STABILITY_STATIONARY 2
+#define STABILITY_STABLE     3
+#define STABILITY_MOTION     4
 
 /* ------------------------------------------------------------ *
- * global variables                                             *
+ * global variables, defined in i2c_bno080.c. The sensor state  *
+ * is thread-local: in multi-bus mode each reader thread runs   *
+ * the driver code on its own bus, see multi_bno080.c.          *
  * ------------------------------------------------------------ */
 // I2C file descriptor
-int i2cfd;
+extern __thread int i2cfd;
 // debug flag, 0 = normal, 1 = debug mode
-int verbose;
+extern int verbose;
 // Each packet has a header of 4 bytes
-uint8_t shtpHeader[4];
+extern __thread uint8_t shtpHeader[4];
 // The data array for read and write operations
-uint8_t shtpData[MAX_PACKET_SIZE];
-// 6 SHTP channels. Each channel has its own seqnum
-uint8_t sequence[6];
+extern __thread uint8_t shtpData[MAX_PACKET_SIZE];
+// 6 SHTP channels. Each channel has its own host-to-hub seqnum
+extern __thread uint8_t sequence[6];
 // Commands sequence number inside the command packet
-uint8_t cmdsequence;
+extern __thread uint8_t cmdsequence;
 // > 10 words in a metadata, but we'll stop at Q point 3
-unsigned int metaData[MAX_METADATA_SIZE];
-//These are the raw sensor values pulled from the user requested Input Report
-uint16_t rawAccelX, rawAccelY, rawAccelZ, accelAccuracy;
-uint16_t rawLinAccelX, rawLinAccelY, rawLinAccelZ, accelLinAccuracy;
-uint16_t rawGyroX, rawGyroY, rawGyroZ, gyroAccuracy;
-uint16_t rawMagX, rawMagY, rawMagZ, magAccuracy;
-uint16_t rawQuatI, rawQuatJ, rawQuatK, rawQuatReal, rawQuatRadianAccuracy, quatAccuracy;
-uint16_t stepCount;
-uint8_t stabilityClassifier;
-uint8_t activityClassifier;
-uint8_t *_activityConfidences; //Array that store the confidences of the 9 possible activities
-uint8_t calibrationStatus; //Byte R0 of ME Calibration Response
+extern __thread unsigned int metaData[MAX_METADATA_SIZE];
+//These are the raw sensor values pulled from the user requested Input Report,
+//signed Q-point values, see the *_Q1 Q points below
+extern __thread int16_t rawAccelX, rawAccelY, rawAccelZ;
+extern __thread int16_t rawLinAccelX, rawLinAccelY, rawLinAccelZ;
+extern __thread int16_t rawGyroX, rawGyroY, rawGyroZ;
+extern __thread int16_t rawMagX, rawMagY, rawMagZ;
+extern __thread int16_t rawQuatI, rawQuatJ, rawQuatK, rawQuatReal, rawQuatRadianAccuracy;
+extern __thread int16_t rawGravX, rawGravY, rawGravZ;
+extern __thread int16_t rawGeoI, rawGeoJ, rawGeoK, rawGeoReal, rawGeoRadianAccuracy;
+extern __thread uint8_t accelAccuracy, accelLinAccuracy, gyroAccuracy, magAccuracy, quatAccuracy;
+extern __thread uint8_t gravAccuracy, geoAccuracy;
+extern __thread uint16_t stepCount;
+extern __thread uint8_t stabilityClassifier;
+extern __thread uint8_t tapDetector; //Tap flags, bit 0-5 axis and sign, bit 6 double tap
+extern __thread uint8_t activityClassifier;
+extern __thread uint8_t _activityConfidences[10]; //Confidences of the 10 possible activities
+//Timing of the last input report packet, for --latency
+struct bnotime{
+   uint64_t rx;      // cargo read complete, stats_now() nsecs
+   uint64_t dec;     // reports decoded, stats_now() nsecs
+   int32_t  age;     // hub age of the last returned sample at the interrupt, usecs
+};
+extern __thread struct bnotime reptime;
+extern __thread uint8_t calibrationStatus; //Byte R0 of ME Calibration Response
 //These Q values are defined in the datasheet but can also be obtained by querying the meta data records
-//See the read metadata example for more info
-int16_t rotationVector_Q1;
-int16_t accelerometer_Q1;
-int16_t linear_accelerometer_Q1;
-int16_t gyro_Q1;
-int16_t magnetometer_Q1;
+//See the read metadata example for more info. Same for all sensors, not thread-local.
+extern int16_t rotationVector_Q1;
+extern int16_t accelerometer_Q1;
+extern int16_t linear_accelerometer_Q1;
+extern int16_t gyro_Q1;
+extern int16_t magnetometer_Q1;
 /* ------------------------------------------------------------ *
  * BNO080 versions, status data and other infos struct 14 bytes *
  * ------------------------------------------------------------ */
@@ -159,6 +218,222 @@ struct bnolin{
    double linacc_z;  // Linear Acceleration Z
 };
 
+/* ------------------------------------------------------------ *
+ * Sensor sample, one per input report, 16 bytes. The values    *
+ * stay in the signed Q-point format of the report, float is    *
+ * only made at the output edge, see sample_float(). The binary *
+ * sink writes this struct as is.                               *
+ * ------------------------------------------------------------ */
+struct bnosample{
+   int16_t  v[4];    // report values, value = v * 2^-q
+   uint32_t ts;      // host timestamp in microseconds
+   uint8_t  repid;   // sensor report ID
+   uint8_t  q;       // Q point of v[]
+   uint8_t  acc;     // report status (accuracy) bits
+   uint8_t  dev;     // bus index in multi-bus mode, else 0
+};
+// Reports with a quaternion: 4 valid values in v[], vectors have 3
+#define REPORT_QUAT(id) ((id) == SENSOR_REPORTID_ROT || (id) == SENSOR_REPORTID_GAM \
+                      || (id) == SENSOR_REPORTID_GIR)
+#define SAMPLE_COUNT(s) (REPORT_QUAT((s)->repid) ? 4 : 3)
+#define FRAME_COUNT(f)  (REPORT_QUAT((f)->repid) ? 4 : 3)
+
+/* ------------------------------------------------------------ *
+ * Wake event, one burst of coalesced wake reports, see         *
+ * event_bno080.c. mask has a bit for each report type seen,    *
+ * the values are the last ones of the burst, tap flags are or. *
+ * ------------------------------------------------------------ */
+#define EV_TAP       0x01
+#define EV_STEP      0x02
+#define EV_STABILITY 0x04
+#define EV_ACTIVITY  0x08
+struct bnoevent{
+   uint32_t ts;        // first report of the burst, sink_clock() usecs
+   uint32_t span;      // first to last report in usecs
+   uint16_t reports;   // wake reports coalesced
+   uint16_t steps;     // step counter
+   uint8_t  mask;      // EV_ bits of the reports seen
+   uint8_t  tap;       // tap detector flags
+   uint8_t  stability; // stability classifier
+   uint8_t  activity;  // most likely activity
+};
+
+/* ------------------------------------------------------------ *
+ * Gyro-integrated rotation vector from the channel 5 fast lane *
+ * see fast_bno080.c. The packet has no report header and no    *
+ * timestamp, just the quaternion and the angular velocity.     *
+ * ------------------------------------------------------------ */
+struct gyrosample{
+   int16_t  q[4];    // quaternion I J K real, Q14
+   int16_t  w[3];    // angular velocity X Y Z in rad/s, Q10
+   uint64_t rx;      // cargo read complete, stats_now() nsecs
+   uint32_t seq;     // publish count of the sample
+};
+
+/* ------------------------------------------------------------ *
+ * Multi-bus frame, all devices resampled to the same tick, see *
+ * sync_bno080.c. 40 bytes, written as is by the bin sink.      *
+ * ------------------------------------------------------------ */
+#define MULTI_MAX 4          // max buses in a -b bus list
+struct bnoframe{
+   uint32_t ts;              // output tick, host time in usecs
+   uint8_t  repid;           // sensor report ID
+   uint8_t  q;               // Q point of v[]
+   uint8_t  ndev;            // devices in the bus list
+   uint8_t  mask;            // bit per device with valid values
+   int16_t  v[MULTI_MAX][4]; // values per device, value = v * 2^-q
+};
+
+/* ------------------------------------------------------------ *
+ * Window of samples in structure of arrays layout, each array  *
+ * 64-byte aligned, see win_bno080.c. The close callback gets a *
+ * view of the arrays, valid until it returns.                  *
+ * ------------------------------------------------------------ */
+#define WIN_ALIGN 64
+#define WIN_LINE  32         // int16_t values per 64-byte line
+struct bnowin{
+   int16_t  *v[4];           // values per axis, Q-point
+   uint32_t *ts;             // host timestamps in usecs
+   uint8_t  *acc;            // accuracy per sample
+   int      len;             // samples in the window
+   int      cap;             // window closes at this many samples
+   uint32_t span;            // window closes after this many usecs
+   uint32_t seq;             // window number
+   uint8_t  repid;           // report ID fed into the window
+   uint8_t  q;               // Q point of v[]
+   uint8_t  count;           // valid axes in v[]
+   void     (*done)(const struct bnowin*, void*); // close callback
+   void     *arg;            // callback argument
+   void     *mem;            // one allocation for all arrays
+};
+
+/* ------------------------------------------------------------ *
+ * Buffered output sink. Records are formatted into buf and     *
+ * written out in large chunks by sink_flush().                 *
+ * ------------------------------------------------------------ */
+#define SINK_BUFSIZE 65536
+typedef enum {
+   SINK_CSV   = 0x00,
+   SINK_JSONL = 0x01,
+   SINK_BIN   = 0x02
+} sinkfmt_t;
+
+struct sink{
+   int       fd;     // output file descriptor
+   sinkfmt_t fmt;    // output record format
+   size_t    len;    // bytes waiting in buf
+   uint32_t  first;  // timestamp of the oldest buffered record
+   int       devcol; // 1 = text records start with the bus index
+   int       frames; // devices per --sync frame, 0 = sample records
+   uint64_t  wait_ns; // time in write(), read by ratectl_sink()
+   char      buf[SINK_BUFSIZE];
+};
+
+/* ------------------------------------------------------------ *
+ * Transaction statistics. Latencies are kept in log-linear     *
+ * histograms with microsecond values, see stats_bno080.c.      *
+ * ------------------------------------------------------------ */
+#define HIST_BUCKETS   240
+#define STATS_JSONSIZE 65536
+typedef enum {
+   OP_SEND    = 0x00,   // sendPacket() I2C write
+   OP_RECV    = 0x01,   // receivePacket() header and cargo read
+   OP_CALSTAT = 0x02,   // get_calstat() command round-trip
+   OP_PRODID  = 0x03,   // get_prodid() request and both responses
+   OP_FRS     = 0x04,   // get_frs() flash record read
+   OP_RESET   = 0x05,   // bno_reset() until SH-2 init
+   OP_ERRLIST = 0x06,   // get_shtp_errors() round-trip
+   OP_FEATURE = 0x07,   // set_feature() until feature response
+   OP_WAKE    = 0x08,   // power on until the first input report
+   OP_COUNT
+} statop_t;
+
+struct hist{
+   uint64_t count;      // number of samples
+   uint64_t sum;        // sum of all samples in usecs
+   uint64_t min;        // smallest sample
+   uint64_t max;        // largest sample
+   uint32_t bucket[HIST_BUCKETS];
+};
+struct chanstats{
+   uint64_t packets[2]; // [0] sent, [1] received
+   uint64_t bytes[2];   // [0] sent, [1] received
+   struct hist lat[2];  // bus transfer time per packet
+   uint64_t gaps;       // sequence jumps forward (packets lost)
+   uint64_t lost;       // packets missing in those jumps
+   uint64_t dups;       // repeated sequence numbers
+   uint64_t reorders;   // sequence numbers older than expected
+   uint8_t  rxseq;      // last received sequence number
+   uint8_t  seqvalid;   // rxseq holds a value
+   uint16_t winpkts;    // packets in the current check window
+   uint16_t winbad;     // sequence errors in the current window
+};
+typedef enum {
+   SEQ_OK      = 0x00,  // next expected sequence number
+   SEQ_GAP     = 0x01,  // packets were lost
+   SEQ_DUP     = 0x02,  // same sequence number again
+   SEQ_REORDER = 0x03   // older sequence number
+} seqres_t;
+/* ------------------------------------------------------------ *
+ * Error classes and recovery paths, see recov_bno080.c         *
+ * ------------------------------------------------------------ */
+typedef enum {
+   ERR_NONE    = 0x00,
+   ERR_BUS     = 0x01,  // I2C transfer failed (NACK, EIO)
+   ERR_SHORT   = 0x02,  // I2C transfer returned fewer bytes
+   ERR_PROTO   = 0x03,  // invalid SHTP header
+   ERR_TIMEOUT = 0x04,  // expected response did not arrive
+   ERR_COUNT
+} bnoerr_t;
+typedef enum {
+   RECOV_RETRY   = 0x00, // write retried after backoff
+   RECOV_PROBE   = 0x01, // header probe re-sync
+   RECOV_RESET   = 0x02, // soft reset of the hub
+   RECOV_RESTORE = 0x03, // enabled features restored
+   RECOV_OK      = 0x04, // recovery succeeded
+   RECOV_FAILED  = 0x05, // recovery gave up
+   RECOV_COUNT
+} recovstate_t;
+extern __thread uint32_t featureInterval[256];
+// Set Feature flags bit 2: report wakes the host, runs while the hub sleeps
+#define FEATURE_WAKE 0x04
+extern __thread uint8_t featureFlags[256];
+
+struct bnostats{
+   uint64_t start;      // stats_init() time in nsecs
+   uint64_t errors[ERR_COUNT];   // errors per class
+   uint64_t recov[RECOV_COUNT];  // entries per recovery path
+   struct hist recovtime;        // time per recovery in usecs
+   uint64_t resyncs;    // stream resyncs after sequence errors
+   volatile int resync; // set when a channel needs a resync
+   struct hist op[OP_COUNT];
+   struct chanstats chan[SHTP_CHANNELS];
+};
+extern __thread struct bnostats stats;
+extern volatile sig_atomic_t stats_signal;
+
+/* ------------------------------------------------------------ *
+ * Packet trace event, 32 bytes, see trace_bno080.c             *
+ * ------------------------------------------------------------ */
+#define TRACE_CARGO 15
+typedef enum {
+   TRACE_TX     = 0x00,  // packet sent
+   TRACE_RX     = 0x01,  // packet received
+   TRACE_NODATA = 0x02,  // header read, no cargo waiting
+   TRACE_ERR    = 0x03   // I2C transfer failed, err = errno
+} tracetype_t;
+
+struct trace_ev{
+   uint64_t ts;          // stats_now() time in nsecs
+   uint8_t  type;        // tracetype_t
+   uint8_t  err;         // errno (ERR), subtransfer bit (RX)
+   uint16_t len;         // packet length incl. header
+   uint8_t  cargolen;    // valid bytes in cargo[]
+   uint8_t  head[4];     // SHTP header: length, channel, sequence
+   uint8_t  cargo[TRACE_CARGO]; // first cargo bytes
+};
+extern volatile sig_atomic_t trace_signal;
+
 /* ------------------------------------------------------------ *
  * BNO080 accelerometer gyroscope magnetometer config structs   *
  * ------------------------------------------------------------ */
@@ -182,6 +457,77 @@ struct bnogconf{
    int aslpdur;      // p-1 reg 0x0D gyroscope auto sleep dur
 };
 
+/* ------------------------------------------------------------ *
+ * Asynchronous SHTP request, see cmd_bno080.c. A request is    *
+ * complete after "expect" matching responses were received.    *
+ * ------------------------------------------------------------ */
+#define CMD_REQMAX  17
+#define CMD_RESPMAX 64
+typedef enum {
+   CMD_IDLE    = 0x00,
+   CMD_PENDING = 0x01,
+   CMD_DONE    = 0x02,
+   CMD_FAILED  = 0x03
+} cmdstate_t;
+
+struct bnocmd{
+   uint8_t  chan;               // request channel
+   uint8_t  rchan;              // response channel
+   uint8_t  report;             // response report ID
+   uint8_t  cmd;                // 0xF1 match: command
+   uint8_t  seq;                // 0xF1 match: command sequence
+   uint16_t frs;                // 0xF3 match: FRS record type
+   uint8_t  req[CMD_REQMAX];    // request cargo
+   int      reqlen;             // request cargo length
+   int      expect;             // responses to collect
+   int      got;                // responses received
+   int      op;                 // statop_t recorded at completion
+   cmdstate_t state;            // request state
+   uint64_t start;              // submit time in nsecs
+   int      len[2];             // response cargo lengths
+   uint8_t  resp[2][CMD_RESPMAX]; // response cargo
+};
+
+/* ------------------------------------------------------------ *
+ * Input report descriptor, one per SH-2 report ID. Reports are *
+ * a 4-byte header (ID, sequence, status, delay) followed by    *
+ * nval fields of width bytes at offset off. decode() reads the *
+ * fields and hands them to store(), len is used to step to the *
+ * next report.                                                 *
+ * ------------------------------------------------------------ */
+struct repdesc{
+   const char *name;            // short name for debug output
+   uint8_t  len;                // report length, 0 = unknown ID
+   uint8_t  off;                // offset of the first field
+   uint8_t  nval;               // number of fields
+   uint8_t  width;              // field width in bytes: 1, 2 or 4
+   uint8_t  sign;               // 1 = signed fields
+   uint8_t  q;                  // default Q point, 0 = integer
+   void   (*decode)(const struct repdesc*, const uint8_t*);
+   void   (*store)(const int16_t*, uint8_t); // values, accuracy
+};
+
+/* ------------------------------------------------------------ *
+ * Adaptive report rate controller state. The interval of one   *
+ * report is moved between min_us (motion) and max_us (at rest) *
+ * based on the stability classifier. Slowing down needs "hold" *
+ * consecutive at-rest reports per step, speeding up is instant.*
+ * The consumer demand starts at the -i interval and backs off  *
+ * while the -f sink output blocks, see ratectl_sink().         *
+ * ------------------------------------------------------------ */
+struct ratectl{
+   uint8_t  repid;     // controlled sensor report ID
+   uint32_t min_us;    // shortest allowed report interval
+   uint32_t max_us;    // longest allowed report interval
+   uint32_t base_us;   // -i interval, demand of a consumer keeping up
+   uint32_t demand_us; // interval requested by the consumer
+   uint64_t win_start; // start of the sink backpressure window
+   uint32_t cur_us;    // interval currently set on the sensor
+   int      still;     // consecutive at-rest classifier reports
+   int      hold;      // at-rest reports needed to slow down 1 step
+   int      changes;   // number of Set Feature updates issued
+};
+
 /* ------------------------------------------------------------ *
  * Operations and power mode, name to value translation         *
  * ------------------------------------------------------------ */
@@ -194,7 +540,7 @@ typedef enum {
 /* ------------------------------------------------------------ *
  * external function prototypes for I2C bus communication code  *
  * ------------------------------------------------------------ */
-extern void shtp_init(char*, char*);      // Start I2C and SHTP msgs
+extern int shtp_init(char*, char*);       // Start I2C and SHTP msgs
 extern int set_page0();                   // set register map page 0
 extern int set_page1();                   // set register map page 1
 extern int get_calstat(struct bnocal*);   // read calibration status
@@ -207,6 +553,7 @@ extern int get_qua(struct bnoqua*);       // read quaternation data
 extern int get_gra(struct bnogra*);       // read gravity data
 extern int get_lin(struct bnolin*);       // read linar acceleration data
 extern int get_serial(double *serial);    // get the sensor serial #
+extern int get_info(struct prodid[], struct bnocal*, double*); // -t inf queries
 extern int get_clksrc();                  // get the clock source setting
 extern void print_clksrc();               // print clock source setting
 extern int set_mode();                    // set the sensor ops mode
@@ -217,6 +564,7 @@ extern int set_power(power_t);            // set the sensor power mode
 extern int get_shtp_errors();             // get the shtp error list
 extern int print_shtp_errors();           // print the shtp error list
 extern int get_power();                   // get the sensor power mode
+extern uint64_t pwr_cycle(uint64_t*, uint32_t); // sleep until next cycle
 extern int print_power(int);              // print power mode string
 extern int get_sstat();                   // get system status code
 extern int print_sstat(int);              // print system status string
@@ -224,9 +572,7 @@ extern int get_remap(char);               // get the axis remap values
 extern int print_remap_conf(int);         // print axis configuration
 extern int print_remap_sign(int);         // print the axis remap +/-
 extern int bno_dump();                    // dump the register map data
-extern void bno_reset();                  // reset the sensor
-extern int save_cal(char*);               // write calibration to file
-extern int load_cal(char*);               // load calibration from file
+extern int bno_reset();                   // reset the sensor
 extern int get_acc_conf(struct bnoaconf*);// get accelerometer config
 extern int get_mag_conf(struct bnomconf*);// get magnetometer config
 extern int get_gyr_conf(struct bnogconf*);// get gyroscope config
@@ -236,3 +582,126 @@ extern int set_gyr_conf();                // set gyroscope config
 extern void print_acc_conf();             // print accelerometer config
 extern void print_mag_conf();             // print magnetometer config
 extern void print_gyr_conf();             // print gyroscope config
+extern uint8_t *tx_begin(uint8_t, int);   // channel TX cargo buffer
+extern int sendPacket(uint8_t, int);      // send TX cargo to channel
+extern int receivePacket();               // read next packet, cargo len
+extern uint32_t readu32(uint8_t*);        // little-endian 32-bit value
+extern uint16_t read16(uint8_t*);         // little-endian 16-bit value
+extern int set_feature(uint8_t, uint32_t);// enable report at interval
+extern int get_report();                  // read next input report
+extern int parseInputReport(int);         // decode input report data
+extern int report_next();                 // next report of the packet
+extern int report_sample(struct bnosample*, int); // its sample
+extern const struct repdesc *report_desc(uint8_t); // report layout
+extern uint8_t report_byname(const char*); // report ID by table name
+extern void report_qinit();               // default Q points from table
+extern void lat_add(uint8_t, uint64_t);   // record sample age per stage
+extern void lat_print(FILE*);             // print --latency table
+extern float qToFloat(int16_t, uint8_t);  // Q-point value to float
+extern int ratectl_init(struct ratectl*, uint8_t, uint32_t, uint32_t, uint32_t);
+extern int ratectl_update(struct ratectl*); // feed stability report
+extern int ratectl_demand(struct ratectl*, uint32_t); // set consumer demand
+extern int ratectl_sink(struct ratectl*, struct sink*); // demand from sink
+extern uint32_t sink_clock();             // monotonic time in usecs
+extern int sink_open(struct sink*, char*);// open output sink fmt:file
+extern int sink_write(struct sink*, struct bnosample*); // add one sample
+extern int sink_flush(struct sink*);      // write buffered records
+extern int sink_close(struct sink*);      // flush and close sink
+extern int fill_sample(struct bnosample*, int); // raw data to sample
+extern int sample_float(struct bnosample*, float*); // values as float
+extern int win_init(struct bnowin*, uint8_t, uint32_t, int,
+                    void (*)(const struct bnowin*, void*), void*);
+extern void win_free(struct bnowin*);     // release window arrays
+extern void win_push(struct bnowin*, struct bnosample*); // add sample
+extern void win_close(struct bnowin*);    // hand window to callback
+extern int win_add(struct bnowin*);       // register for win_feed()
+extern void win_feed(struct bnosample*);  // sample to all windows
+extern void win_flush();                  // close partial windows
+extern void win_print(const struct bnowin*, void*); // --window output
+extern int filt_parse(char*, float);      // set up --filter chain
+extern int filt_start(uint8_t, void (*)(struct bnosample*, void*), void*);
+extern int snap_start(char*, char*, int); // start HTML/JSON snapshots
+extern void snap_update(struct bnosample*); // store latest sample
+extern void snap_stop();                  // stop snapshot writer
+extern int publish_file(char*, char*, int); // atomic file replace
+extern uint64_t stats_now();              // monotonic time in nsecs
+extern void stats_init(char*, char*);     // start stats, SIGUSR1
+extern void stats_op(statop_t, uint64_t); // record operation latency
+extern void stats_chan(int, int, int, uint64_t); // count a packet
+extern void hist_add(struct hist*, uint64_t); // add usec sample
+extern uint64_t hist_pct(struct hist*, double); // percentile value
+extern void stats_print(FILE*);           // print stats summary
+extern void stats_merge(struct bnostats*); // add thread stats to other
+extern int stats_json(char*, int);        // render stats as JSON
+extern int stats_dump(char*);             // write JSON stats to file
+extern void stats_poll(char*);            // handle SIGUSR1 request
+extern seqres_t stats_seq(int, uint8_t);  // check RX sequence number
+extern void stats_seq_reset();            // forget RX sequence state
+extern void trace_init();                 // start trace, SIGUSR2
+extern bnoerr_t bno_classify(int, int, int); // I2C result to error
+extern int recov_retry(int);              // backoff before a retry
+extern int bno_recover(bnoerr_t);         // run the recovery
+extern int bno_fail(bnoerr_t, const char*); // command failed, recover
+extern void print_recov(FILE*);           // print recovery counters
+extern int json_recov(char*, int);        // recovery counters as JSON
+extern int prom_recov(char*, int);        // recovery counters, Prometheus
+extern int prom_shtp(char*, int);         // SHTP error list, Prometheus
+extern int cmd_pending();                 // requests waiting for response
+extern void prom_start(char*);            // start metrics file export
+extern void prom_sample(uint8_t);         // count one delivered sample
+extern void prom_poll(int);               // rewrite metrics if period over
+extern void prom_stop(int);               // write final metrics
+extern int multi_parse(char*, char*);     // split -b bus list
+extern int multi_stream(int, uint32_t, int, void (*)(struct bnosample*, void*), void*);
+extern int sync_start(int, float, void (*)(struct bnoframe*, void*), void*);
+extern void sync_sample(struct bnosample*, void*); // feed --sync frames
+extern int sink_frame(struct sink*, struct bnoframe*); // add one frame
+extern int resamp_parse(char*);           // --resample hz[:msec]
+extern void resamp_start(void (*)(struct bnosample*, void*), void*);
+extern void resamp_sample(struct bnosample*, void*); // feed resampler
+extern void resamp_poll(uint32_t);        // hold ticks past lookahead
+extern void resamp_print(FILE*);          // resampler statistics
+extern int script_run(char*, uint32_t);   // run -s command script
+extern int wd_parse(char*);               // --watchdog frac[:msec]
+extern int wd_start();                    // start the watchdog thread
+extern void wd_stop();                    // end the watchdog thread
+extern int wd_tripped();                  // alarm since the last call
+extern void wd_hold(int);                 // pause for the recovery, 0 = resume
+extern void wd_expect(uint8_t, uint32_t); // report rate was set
+extern void wd_arrival(uint8_t);          // input report came in
+extern void wd_print(FILE*);              // print watchdog table
+extern int prom_wd(char*, int);           // watchdog alarms, Prometheus
+extern int fast_rx(int);                  // publish a channel 5 packet
+extern int fast_take(struct gyrosample*); // newest fast lane sample
+extern void fast_print(FILE*);            // fast lane latency table
+extern int ev_start(char*, char*, uint32_t, char*); // start wake event poller
+extern int ev_take(struct bnoevent*);     // oldest queued wake event
+extern int ev_alive();                    // poller thread still runs
+extern void ev_stop();                    // end poller, hub to normal
+extern void ev_arrival(uint8_t);          // add report to the burst
+extern void ev_print(FILE*);              // print event counters
+extern int cal_config(int, int, int);     // ME calibration acc/gyr/mag
+extern int dcd_save();                    // save DCD to sensor flash
+extern int dcd_autosave(int);             // hub periodic DCD save on/off
+extern int frs_read(uint16_t, uint32_t*, int); // read FRS flash record
+extern int frs_write(uint16_t, uint32_t*, int); // write FRS flash record
+extern int save_cal(char*);               // write calibration to file
+extern int load_cal(char*);               // load calibration from file
+extern int cal_start(char*);              // restore backup, autosave on
+extern void cal_poll(uint8_t);            // backup policy per report
+extern void cal_stop();                   // final backup at exit
+extern void cmd_init(struct bnocmd*, uint8_t, uint8_t*, int, uint8_t, uint8_t, int, int);
+extern void cmd_command(struct bnocmd*, uint8_t, uint8_t*, int); // 0xF2 cmd
+extern void cmd_frs(struct bnocmd*, uint16_t); // FRS read request
+extern int cmd_submit(struct bnocmd*);    // send, register as pending
+extern int cmd_match(int);                // match packet to a request
+extern int cmd_wait();                    // wait for pending requests
+extern int cmd_run(struct bnocmd*);       // submit and wait for one
+extern void cmd_expire();                 // fail requests past timeout
+extern void feature_request(struct bnocmd*, uint8_t, uint32_t); // 0xFD request
+extern int sched_recv(int);               // next packet, 1 = reports
+extern int sched_defer(struct bnocmd*);   // send request when idle
+extern void sched_print(FILE*);           // print scheduler queues
+extern void trace_event(uint8_t, uint8_t, uint16_t, uint8_t*, uint8_t*, int);
+extern void trace_dump(FILE*);            // decode trace ring to text
+extern void trace_poll();                 // handle SIGUSR2 request
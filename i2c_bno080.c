@@ -20,8 +20,41 @@
 #include <stdint.h>
 #include <errno.h>
 #include <math.h>
+#include <time.h>
 #include "getbno080.h"
 
+/* ------------------------------------------------------------ *
+ * Sensor state, declared in getbno080.h. Thread-local, so each *
+ * bus reader thread in multi-bus mode has its own copy.        *
+ * ------------------------------------------------------------ */
+__thread int i2cfd;
+__thread uint8_t shtpHeader[4];
+__thread uint8_t shtpData[MAX_PACKET_SIZE];
+__thread uint8_t sequence[6];
+__thread uint8_t cmdsequence;
+__thread unsigned int metaData[MAX_METADATA_SIZE];
+__thread int16_t rawAccelX, rawAccelY, rawAccelZ;
+__thread int16_t rawLinAccelX, rawLinAccelY, rawLinAccelZ;
+__thread int16_t rawGyroX, rawGyroY, rawGyroZ;
+__thread int16_t rawMagX, rawMagY, rawMagZ;
+__thread int16_t rawQuatI, rawQuatJ, rawQuatK, rawQuatReal, rawQuatRadianAccuracy;
+__thread int16_t rawGravX, rawGravY, rawGravZ;
+__thread int16_t rawGeoI, rawGeoJ, rawGeoK, rawGeoReal, rawGeoRadianAccuracy;
+__thread uint8_t accelAccuracy, accelLinAccuracy, gyroAccuracy, magAccuracy, quatAccuracy;
+__thread uint8_t gravAccuracy, geoAccuracy;
+__thread uint16_t stepCount;
+__thread uint8_t stabilityClassifier;
+__thread uint8_t tapDetector;
+__thread uint8_t activityClassifier;
+__thread uint8_t _activityConfidences[10];
+__thread struct bnotime reptime;
+__thread uint8_t calibrationStatus;
+int16_t rotationVector_Q1;
+int16_t accelerometer_Q1;
+int16_t linear_accelerometer_Q1;
+int16_t gyro_Q1;
+int16_t magnetometer_Q1;
+
 uint32_t readu32(uint8_t *p) {
    uint32_t retval = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
    return retval;
@@ -37,36 +70,72 @@ uint8_t read8(uint8_t *p) {
 
 
 /* ------------------------------------------------------------ *
- * Given the data packet, send the header and then the data.    *
+ * Transmit buffers, one per channel. The 4-byte SHTP header is *
+ * built in front of the cargo, so a packet goes out with one   *
+ * write() and no copy. Requests in flight on other channels    *
+ * keep their bytes, and shtpData[] stays free for responses.   *
+ * ------------------------------------------------------------ */
+static __thread uint8_t txbuf[SHTP_CHANNELS][SHTP_HEADER + SHTP_TXMAX];
+
+/* ------------------------------------------------------------ *
+ * tx_begin() returns the cargo area of the channel TX buffer,  *
+ * with datalen bytes cleared for the caller to fill in.        *
+ * ------------------------------------------------------------ */
+uint8_t *tx_begin(uint8_t channel, int datalen) {
+   uint8_t *cargo = &txbuf[channel][SHTP_HEADER];
+   memset(cargo, 0, datalen);
+   return(cargo);
+}
+
+/* ------------------------------------------------------------ *
+ * Send the datalen cargo bytes in the channel TX buffer, after *
+ * adding the header in front of them. Failed writes are        *
+ * retried with backoff, then the recovery is run and the       *
+ * packet is sent once more. Returns 0, or -1 if the packet     *
+ * could not be sent.                                           *
  * ------------------------------------------------------------ */
-void sendPacket(short channel, short datalen) {
-   uint8_t packetlen = datalen;
-   uint8_t *data;               // local buffer for I2C write data
+int sendPacket(uint8_t channel, int datalen) {
+   if(channel >= SHTP_CHANNELS || datalen > SHTP_TXMAX) {
+      printf("Error: Cannot send %d bytes to channel %d.\n", datalen, channel);
+      return(-1);
+   }
+   uint8_t *data = txbuf[channel];
+   int packetlen = datalen + SHTP_HEADER;
 
    sequence[channel]++;         // increment seq for each packet
-   packetlen = datalen + 4;     // Add four bytes for the header
-   data = malloc(packetlen);    // 4-byte packet header
    data[0] = packetlen & 0xFF;  // packet length LSB
    data[1] = packetlen >> 8;    // packet length MSB
    data[2] = channel;           // channel number
    data[3] = sequence[channel]; // packet sequence num
 
-   // Copy the payload data from shtpData to the I2C data buffer
-   for (short i = 0 ; i < datalen; i++) {
-      data[4+i] = shtpData[i];
-   }
-
-   if(verbose == 1) printf("Debug: TX %3d bytes HEAD", packetlen);
-   for (short i = 0 ; i < packetlen; i++) {
-      if(verbose == 1 && i == 4) printf(" CARGO");
-      if(verbose == 1) printf(" %02X", data[i]);
-   }
-   if(verbose == 1) printf("\n");
-
-   if(write(i2cfd, data, packetlen) != packetlen) {
+   uint64_t start = stats_now();
+   int wbytes, attempt = 0, recovered = 0;
+   while((wbytes = write(i2cfd, data, packetlen)) != packetlen) {
+      int err = errno;
+      trace_event(TRACE_ERR, err, (wbytes > 0) ? wbytes : 0, data, NULL, 0);
+      if(recov_retry(attempt++) == 0) continue;
       printf("Error: I2C write failure %d data\n", packetlen);
-      exit(-1);
+      if(recovered) return(-1);
+      /* ------------------------------------------------------ *
+       * The reset and feature restore reuse the TX buffers, so *
+       * keep the cargo aside. Rare path, the copy is fine here *
+       * ------------------------------------------------------ */
+      static __thread uint8_t txsave[SHTP_TXMAX];
+      memcpy(txsave, &data[SHTP_HEADER], datalen);
+      if(bno_recover(bno_classify(wbytes, packetlen, err)) != 0) return(-1);
+      memcpy(&data[SHTP_HEADER], txsave, datalen);
+      data[0] = packetlen & 0xFF;
+      data[1] = packetlen >> 8;
+      data[2] = channel;
+      // the feature restore used the channel, take a new seqnum
+      data[3] = ++sequence[channel];
+      recovered = 1;
+      attempt = 0;
    }
+   trace_event(TRACE_TX, 0, packetlen, data, &data[SHTP_HEADER], datalen);
+   stats_chan(0, channel, packetlen, start);
+   stats_op(OP_SEND, start);
+   return(0);
 }
 
 /* ------------------------------------------------------------ *
@@ -81,12 +150,15 @@ int receivePacket(void) {
                               // the header byte 2 MSB is set
 
    // 1st Read to get the 4-byte SHTP header with the cargo size
+   uint64_t start = stats_now();
    rbytes = read(i2cfd, shtpHeader, 4);
    err = errno;
 
    if(rbytes != 4) {
+      trace_event(TRACE_ERR, err, (rbytes > 0) ? rbytes : 0, NULL, NULL, 0);
       printf("Error: I2C SHTP header read failure: %d.\n", rbytes);
       printf("Error: %s\n", strerror(err));
+      bno_recover(bno_classify(rbytes, 4, err));
       return(0);
    }
 
@@ -97,12 +169,24 @@ int receivePacket(void) {
    // Check if the subtransfer bit was set (shtpHeader[1] MSB)
    if(shtpHeader[1]&0x80) subtransfer = 1;
 
-   // 2nd Read the remaining cargo data
-   if(datalen == 0) {             // Cargo data is to be received
-      if(verbose == 1) printf("Debug: No SHTP data available at this time.\n");
+   // A header without cargo is the idle reply, no data waiting
+   if(packetlen <= 4) {
+      trace_event(TRACE_NODATA, 0, packetlen, shtpHeader, NULL, 0);
+      return(0);
+   }
+
+   // All-ones headers or unknown channels come from a bus that
+   // lost sync with the hub, not from a real packet
+   if(packetlen == 0x7FFF || shtpHeader[2] >= SHTP_CHANNELS) {
+      trace_event(TRACE_ERR, EPROTO, 4, shtpHeader, NULL, 0);
+      printf("Error: invalid SHTP header %02X %02X %02X %02X\n", shtpHeader[0],
+              shtpHeader[1], shtpHeader[2], shtpHeader[3]);
+      bno_recover(ERR_PROTO);
       return(0);
    }
 
+   // 2nd Read the remaining cargo data
+
    uint8_t data[packetlen];    // Buffer for cargo data
    usleep(1000);               // Wait 100 microsecs before next read
 
@@ -110,46 +194,40 @@ int receivePacket(void) {
    err = errno;
 
    if(rbytes < packetlen) {
+      trace_event(TRACE_ERR, err, (rbytes > 0) ? rbytes : 0, shtpHeader, NULL, 0);
       printf("Error: I2C SHTP data read failure: got %d/%d bytes.\n", rbytes, datalen);
       printf("Error: %s\n", strerror(err));
+      bno_recover(bno_classify(rbytes, packetlen, err));
       return(0);
    }
 
-   // update the sequence counter for the channel
-   sequence[data[2]] = data[3];
-   //if(verbose == 1) printf("Debug: Sequence channel %d is %d\n",
-   //                         data[2], sequence[data[2]]);
+   stats_chan(1, data[2], packetlen, start);
+   stats_op(OP_RECV, start);
 
-   // clear global data array, and write data buffer to it
-   memset(shtpData, 0, sizeof shtpData);
-
-   if(verbose == 1) printf("Debug: RX %3d bytes HEAD", packetlen);
-   for (int i = 0; i < packetlen; i++) {
-      if(verbose == 1 && i == 4) printf(" CARGO");
-      if(verbose == 1 && i < 20) printf(" %02X", data[i]); // only first 20 bytes
-      if(verbose == 1 && i > 19 && i == 20) printf(" +%d more bytes", (packetlen-16));
-      if(i < 4) shtpHeader[i] = data[i]; // Store data into the shtpData array
-      if(i > 3) shtpData[i-4] = data[i]; // Store data into the shtpData array
-   }
-   if(verbose == 1) printf(" ST [%d]\n", subtransfer);
+   // check the hub-to-host sequence number against the expected
+   // one for the channel. sequence[] only counts host-to-hub TX.
+   stats_seq(data[2], data[3]);
 
-   if(data[4] == COMMAND_RESPONSE) {
-      printf("Debug: CMD reportID [%02X] REPseq [%02X] CMD [%02X] CMDseq [%02X] RESPseq [%02X] R0 [%02X]\n",
-              data[4], data[5], data[6], data[7],data[8],data[9]);
+   trace_event(TRACE_RX, subtransfer, packetlen, data, &data[4], datalen);
 
-   }
+   // Store header and cargo into the shtpHeader and shtpData arrays
+   if(datalen > (short) sizeof(shtpData)) datalen = sizeof(shtpData);
+   memcpy(shtpHeader, data, 4);
+   memcpy(shtpData, &data[4], datalen);
    return(datalen);
 }
 
 /* ------------------------------------------------------------ *
  * shtp_init() - Enables the I2C bus communication. Raspberry   *
  * Pi 2 uses i2c-1, RPI 1 used i2c-0, NanoPi also uses i2c-0.   *
+ * Returns 0, or -1 with the bus closed. Reader threads call it *
+ * too, so it must not exit().                                  *
  * ------------------------------------------------------------ */
-void shtp_init(char *i2cbus, char *i2caddr) {
+int shtp_init(char *i2cbus, char *i2caddr) {
 
    if((i2cfd = open(i2cbus, O_RDWR)) < 0) {
       printf("Error failed to open I2C bus [%s].\n", i2cbus);
-      exit(-1);
+      return(-1);
    }
    if(verbose == 1) printf("Debug: I2C bus device: [%s]\n", i2cbus);
    /* --------------------------------------------------------- *
@@ -160,7 +238,8 @@ void shtp_init(char *i2cbus, char *i2caddr) {
 
    if(ioctl(i2cfd, I2C_SLAVE, addr) != 0) {
       printf("Error can't find sensor at I2C address [0x%02X].\n", addr);
-      exit(-1);
+      close(i2cfd);
+      return(-1);
    }
    usleep(I2CDELAY);
 
@@ -179,8 +258,37 @@ void shtp_init(char *i2cbus, char *i2caddr) {
     * the error lost should be empty and we don't need tp reset *
     * --------------------------------------------------------- */
    int errorcount = get_shtp_errors();
-   if(errorcount > 0) bno_reset(addr);
+   if(errorcount > 0 && bno_reset() != 0) {
+      printf("Error: sensor reset failed during initialization.\n");
+      close(i2cfd);
+      return(-1);
+   }
    if(verbose == 1) printf("Debug: OK  Initialization complete\n");
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * errlist_parse() - keep the error list of a completed request *
+ * for print_shtp_errors(), returns the number of entries.      *
+ * ------------------------------------------------------------ */
+static __thread uint8_t errlist[CMD_RESPMAX];
+static __thread int errcount = -1;
+
+static int errlist_parse(struct bnocmd *c) {
+   memcpy(errlist, c->resp[0], c->len[0]);
+   errcount = c->len[0] - 1;       // datalen minus 1 report byte
+   if(verbose == 1) printf("Debug: OK  Error list %d entries\n", errcount);
+   return(errcount);
+}
+
+/* ------------------------------------------------------------ *
+ * errlist_request() - prepare the SHTP get error list request, *
+ * CMD 0x01 on the command channel, answered on the same one:   *
+ *  RX   5 bytes HEAD 05 80 00 03 CARGO 01 ST [0]               *
+ * ------------------------------------------------------------ */
+static void errlist_request(struct bnocmd *c) {
+   uint8_t req[1] = { 0x01 };
+   cmd_init(c, CHANNEL_COMMAND, req, 1, CHANNEL_COMMAND, 0x01, 1, OP_ERRLIST);
 }
 
 int get_shtp_errors() {
@@ -188,37 +296,29 @@ int get_shtp_errors() {
    // header data. SH2 will add the code 2 entry to the error list
    // sensor reset clears the error list.
    // char data[3] = { 2, 3, 4}; write(i2cfd, data, 3);
-
-   /* --------------------------------------------------------- *
-    * SHTP get error list from sensor                           *
-    * --------------------------------------------------------- */
-   shtpData[0] = 0x01;                // CMD 0x01 gets error list
-   sendPacket(CHANNEL_COMMAND, 1);    // Write 1 byte to chan CMD
-   usleep(I2CDELAY);                  // 100 msecs before next I2C
-
-   /* --------------------------------------------------------- *
-    * Get the SHTP error list, after reset it should be clean   *
-    *  RX   5 bytes HEAD 05 80 00 03 CARGO 01 ST [0]            *
-    * --------------------------------------------------------- */
-   // Wait for answer packet
-   int datalen;
-   while ((datalen = receivePacket()) != 0) {
-      if(shtpHeader[2] == CHANNEL_COMMAND && shtpData[0] == 0x01) break;
-      usleep(I2CDELAY);              // Delay 100 microsecs before next I2C
-   }
-
-   if(shtpHeader[2] != CHANNEL_COMMAND || shtpData[0] != 1) {
+   struct bnocmd c;
+   errlist_request(&c);
+   if(cmd_run(&c) != 0) {
       printf("Error: can't get SHTP error list\n");
       return(-1);
    }
+   return(errlist_parse(&c));
+}
 
-   /* --------------------------------------------------------- *
-    * Calculate the error counter                               *
-    * --------------------------------------------------------- */
-   int errcount = datalen - 1; // datalen minus 1 report byte
-   if(verbose == 1) printf("Debug: OK  Error list %d entries\n", errcount);
-
-   return(errcount);
+/* ------------------------------------------------------------ *
+ * prom_shtp() - the last SHTP error list read, in Prometheus   *
+ * text format: entries per error code. Not re-read here, a     *
+ * request in the middle of a stream would delay the reports.   *
+ * ------------------------------------------------------------ */
+int prom_shtp(char *p, int size) {
+   int count[256] = {0};
+   int n = snprintf(p, size, "# HELP bno080_shtp_errors SHTP error list entries by code, at the last read.\n"
+                             "# TYPE bno080_shtp_errors gauge\n");
+   for(int i = 1; i <= errcount; i++) count[errlist[i]]++;
+   for(int i = 0; i < 256 && n < size; i++) {
+      if(count[i] > 0) n += snprintf(p+n, size-n, "bno080_shtp_errors{code=\"%d\"} %d\n", i, count[i]);
+   }
+   return(n);
 }
 
 /* ------------------------------------------------------------ *
@@ -243,25 +343,19 @@ const static char* shtpErrorStr[] = {
 };
 
    /* --------------------------------------------------------- *
-    * Check if shtpHeader and Data contain the error list       *
+    * Check if get_shtp_errors() or get_info() read the list    *
     * --------------------------------------------------------- */
-   if(shtpHeader[2] != CHANNEL_COMMAND || shtpData[0] != 0x01) {
+   if(errcount < 0) {
       if(verbose == 1) printf("Debug: Error list not read\n");
       return 1;
    }
 
-   /* --------------------------------------------------------- *
-    * Calculate the error counter                               *
-    * --------------------------------------------------------- */
-   short packetlen = ((short) shtpHeader[1] << 8 | shtpHeader[0]);
-   packetlen &= ~(1 << 15);        // Clear the MSbit.
-   short errcount = packetlen - 5; // minus 4 header and 1 report
-
    printf("SHTP Errors # : %d entries\n", errcount);
    if(errcount == 0) return(0);
 
    for(int i=0; i<errcount; i++) {
-      printf("SHTP Error %2d : %d = %s\n", i, shtpData[1+i], shtpErrorStr[shtpData[1+i]]);
+      const char *str = (errlist[1+i] < ARRAY_ITEMS(shtpErrorStr)) ? shtpErrorStr[errlist[1+i]] : "Unknown";
+      printf("SHTP Error %2d : %d = %s\n", i, errlist[1+i], str);
    }
 
    return(0);
@@ -329,15 +423,23 @@ int bno_dump() {
 }
 
 /* ------------------------------------------------------------ *
- * bno_reset() resets the sensor.                               *
+ * bno_reset() resets the sensor. Returns 0, or -1 if the hub   *
+ * did not come back with the expected packets.                 *
  * ------------------------------------------------------------ */
-void bno_reset() {
+int bno_reset() {
    /* --------------------------------------------------------- *
     * Send the "reset" command and watch the response packets   *
     * --------------------------------------------------------- */
-   shtpData[0] = 1;                   // CMD1 = reset
-   sendPacket(CHANNEL_EXECUTABLE, 1); // Write 1 byte to chan EXE
-   usleep(700000);                    // 700 millisecs for reboot
+   uint64_t start = stats_now();
+   uint8_t *tx = tx_begin(CHANNEL_EXECUTABLE, 1);
+   tx[0] = 1;                         // CMD1 = reset
+   if(sendPacket(CHANNEL_EXECUTABLE, 1) != 0) return(-1);
+   // 700 millisecs for reboot, to an absolute time: a signal
+   // (--watchdog SIGALRM) must not cut the wait short
+   uint64_t boot = stats_now() + 700000000ULL;
+   struct timespec ts = { boot / 1000000000ULL, boot % 1000000000ULL };
+   while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+   stats_seq_reset();                 // hub restarts its seq numbers
 
    /* --------------------------------------------------------- *
     * After reset,  we get 3 packets:                           *
@@ -346,7 +448,7 @@ void bno_reset() {
    receivePacket();
    if(shtpHeader[2] != CHANNEL_COMMAND || shtpHeader[3] != 1) {
       printf("Error: can't get SHTP advertising.\n");
-      exit(-1);
+      return(-1);
    }
    usleep(I2CDELAY);            // Delay 100 microsecs before next I2C
 
@@ -357,7 +459,7 @@ void bno_reset() {
    if(shtpHeader[2] != CHANNEL_EXECUTABLE || shtpHeader[3] != 1 
       || shtpData[0] != 1) {
       printf("Error: can't get 'reset complete' status.\n");
-      exit(-1);
+      return(-1);
    }
    usleep(I2CDELAY);            // Delay 100 microsecs before next I2C
    /* --------------------------------------------------------- *
@@ -366,57 +468,35 @@ void bno_reset() {
    receivePacket();
    if(shtpHeader[2] != CHANNEL_CONTROL || shtpHeader[3] != 1) {
       printf("Error: can't get SH2 initialization.\n");
-      exit(-1);
+      return(-1);
    }
 
+   stats_op(OP_RESET, start);
    if(verbose == 1) printf("Debug: OK  Reset complete\n");
+   return(0);
 }
 
 /* ------------------------------------------------------------ *
- * get_calstat() gets the calibration status from the sensor.   *
+ * calstat_request() - prepare the Get ME Calibration command,  *
+ * SH-2 reference manual 6.4.7.2                                *
  * ------------------------------------------------------------ */
-int get_calstat(struct bnocal *bno_ptr) {
-   /* --------------------------------------------------------- *
-    * Get ME Calibration Command SH-2 reference manual 6.4.7.2  *
-    * --------------------------------------------------------- */
-   cmdsequence++;
-   shtpData[0] = COMMAND_REQUEST;   // CMD request
-   shtpData[1] = cmdsequence;       // CMD sequence number
-   shtpData[2] = 0x07;              // ME Calibration CMD 0x07
-   shtpData[3] = 0x00;              // Reserved
-   shtpData[4] = 0x00;              // Reserved
-   shtpData[5] = 0x00;              // Reserved
-   shtpData[6] = 0x01;              // Reserved
-   shtpData[7] = 0x00;              // Get ME Calibration 0x01
-   shtpData[8] = 0x00;              // Reserved
-   shtpData[9] = 0x00;              // Reserved
-   shtpData[10] = 0x00;             // Reserved
-   shtpData[11] = 0x00;             // Reserved
-   sendPacket(CHANNEL_CONTROL, 12); // Write 12 bytes to CMD channel
-   usleep(I2CDELAY);                // Delay 100 microsecs befoer next I2C
-
-   // Wait for answer packet
-   int datalen;
-   while ((datalen = receivePacket()) != 0) {
-      if(shtpHeader[2] == CHANNEL_CONTROL && shtpData[0] == 0xF1) break;
-      usleep(I2CDELAY);              // Delay 100 microsecs before next I2C
-   }
-
-   if(shtpData[0] != 0xF1) {
-      printf("Error: Getting command response\n");
-      exit(-1);
-   }
-   if(shtpData[2] != 0x07) {
-      printf("Error: Getting ME calibration response\n");
-      exit(-1);
-   }
-   if(verbose == 1) printf("Debug: OK  ME calibration received, data [%02X]\n",
-                            shtpData[2]);
+static void calstat_request(struct bnocmd *c) {
+   uint8_t p[9] = { 0x00, 0x00, 0x00, 0x01 };  // P3 0x01 = get
+   cmd_command(c, 0x07, p, OP_CALSTAT);
+}
 
-   bno_ptr->acal_st = shtpData[6]; // accelerometer calibration status
-   bno_ptr->gcal_st = shtpData[7]; // gyroscope calibration status
-   bno_ptr->mcal_st = shtpData[8]; // magnetometer calibration status
-   bno_ptr->pcal_st = shtpData[9]; // planar accel calibration status
+/* ------------------------------------------------------------ *
+ * calstat_parse() - calibration enables from the response      *
+ * ------------------------------------------------------------ */
+static int calstat_parse(struct bnocal *bno_ptr, struct bnocmd *c) {
+   uint8_t *d = c->resp[0];
+   if(c->len[0] < 10) return(bno_fail(ERR_PROTO, "Short ME calibration response"));
+   if(verbose == 1) printf("Debug: OK  ME calibration received, data [%02X]\n", d[2]);
+
+   bno_ptr->acal_st = d[6]; // accelerometer calibration status
+   bno_ptr->gcal_st = d[7]; // gyroscope calibration status
+   bno_ptr->mcal_st = d[8]; // magnetometer calibration status
+   bno_ptr->pcal_st = d[9]; // planar accel calibration status
    if(verbose == 1) {
       printf("Debug: calibration enable settings");
       printf(" acc=[%d]", bno_ptr->acal_st);
@@ -428,57 +508,25 @@ int get_calstat(struct bnocal *bno_ptr) {
 }
 
 /* ------------------------------------------------------------ *
- * Calibration offset is stored in 3x6 (18) registers 0x55~0x66 *
- * plus 4 registers 0x67~0x6A accelerometer/magnetometer radius *
- * ------------------------------------------------------------ */
-int get_caloffset(struct bnocal *bno_ptr) {
-   /* --------------------------------------------------------- *
-    * Registers may not update in fusion mode, switch to CONFIG *
-    * --------------------------------------------------------- */
-
-   /* ------------------------------------------------------------ *
-    * assigning accelerometer X-Y-Z offset, range per G-range      *
-    * 16G = +/-16000, 8G = +/-8000, 4G = +/-4000, 2G = +/-2000     *
-    * ------------------------------------------------------------ */
-   return(0);
-}
-
-/* ------------------------------------------------------------ *
- * save_cal() - writes calibration data to file for reuse       *
+ * get_calstat() gets the calibration status from the sensor.   *
  * ------------------------------------------------------------ */
-int save_cal(char *file) {
-   /* --------------------------------------------------------- *
-    * Read 34 bytes calibration data from registers 0x43~66,    *
-    * plus 4 reg 0x67~6A with accelerometer/magnetometer radius *
-    * switch to CONFIG, data is only visible in non-fusion mode *
-    * --------------------------------------------------------- */
-   return(0);
+int get_calstat(struct bnocal *bno_ptr) {
+   struct bnocmd c;
+   calstat_request(&c);
+   if(cmd_run(&c) != 0) {
+      printf("Error: Getting ME calibration response\n");
+      return(-1);
+   }
+   return(calstat_parse(bno_ptr, &c));
 }
 
 /* ------------------------------------------------------------ *
- * load_cal() load previously saved calibration data from file  *
+ * get_caloffset() - the BNO080 keeps its offsets in the opaque *
+ * DCD record (see cal_bno080.c), only the calibration enable   *
+ * flags are readable. They are returned via get_calstat().     *
  * ------------------------------------------------------------ */
-int load_cal(char *file) {
-   /* -------------------------------------------------------- *
-    *  Open the calibration data file for reading.             *
-    * -------------------------------------------------------- */
-   FILE *calib;
-   if(! (calib=fopen(file, "r"))) {
-      printf("Error: Can't open %s for reading.\n", file);
-      exit(-1);
-   }
-   if(verbose == 1) printf("Debug: Load from file: [%s]\n", file);
-
-   /* -------------------------------------------------------- *
-    * Read 34 bytes from file into data[], starting at data[1] *
-    * -------------------------------------------------------- */
-  // char data[CALIB_BYTECOUNT+1] = {0};
-   //data[0] = ACC_OFFSET_X_LSB_ADDR;
-   //data[0] = BNO080_SIC_MATRIX_0_LSB_ADDR;
-   //int inbytes = fread(&data[1], 1, CALIB_BYTECOUNT, calib);
-   //fclose(calib);
-
-   return(0);
+int get_caloffset(struct bnocal *bno_ptr) {
+   return(get_calstat(bno_ptr));
 }
 
 /* ------------------------------------------------------------ *
@@ -514,138 +562,229 @@ void print_unit(int unit_sel) {
    else printf("Windows\n");
 }
 
+/* ------------------------------------------------------------ *
+ * prodid_request() - prepare the 0xF9 product ID request. The  *
+ * hub answers with two 0xF8 reports, SH-2 manual 6.3.1/6.3.2   *
+ * ------------------------------------------------------------ */
+static void prodid_request(struct bnocmd *c) {
+   uint8_t req[2] = { PRODUCT_ID_REQUEST, 0x00 };
+   cmd_init(c, CHANNEL_CONTROL, req, 2, CHANNEL_CONTROL, PRODUCT_ID_RESPONSE, 2, OP_PRODID);
+}
+
+/* ------------------------------------------------------------ *
+ * prodid_parse() - product report data to info structures      *
+ * ------------------------------------------------------------ */
+static int prodid_parse(struct prodid prodlist[], struct bnocmd *c) {
+   for(int i = 0; i < 2; i++) {
+      uint8_t *d = c->resp[i];
+      if(c->len[i] < 14) return(bno_fail(ERR_PROTO, "Short SHTP product-ID report"));
+      prodlist[i].rep_id  = read8(&d[0]);    // report 0xF8 byte 0 Report ID
+      prodlist[i].r_cause = read8(&d[1]);    // report 0xF8 byte 1 Reset Cause
+      prodlist[i].sw_vmaj = read8(&d[2]);    // report 0xF8 byte 2 SW Version Major
+      prodlist[i].sw_vmin = read8(&d[3]);    // report 0xF8 byte 3 SW Version Minor
+      prodlist[i].sw_pnm  = readu32(&d[4]);  // report 0xF8 byte 4-7 SW Part Number
+      prodlist[i].sw_bnm  = readu32(&d[8]);  // report 0xF8 byte 8-11 SW Build Number
+      prodlist[i].sw_vpn  = read16(&d[12]);  // report 0xF8 byte 12-13 SW Version Patch
+   }
+   if(verbose == 1) printf("Debug: OK  SHTP product-ID reports received\n");
+   return(0);
+}
+
 /* ------------------------------------------------------------ *
  * get_prodid() queries the BNO080 and write the info data into *
  * the global prodid struct bnoinf defined in getbno080.h       *
  * ------------------------------------------------------------ */
 int get_prodid(struct prodid prodlist[]) {
-   /* --------------------------------------------------------- *
-    * SHTP communication channel 2: write 0xF9 request          *
-    * --------------------------------------------------------- */
-   shtpData[0] = PRODUCT_ID_REQUEST;
-   sendPacket(CHANNEL_CONTROL, 1);  // Write 1 bytes to CTL channel
-   usleep(I2CDELAY);                // Delay 100 microsecs befoer next I2C
-
-   /* --------------------------------------------------------- *
-    * SHTP communication channel 2: read 1st 0xF8 response      *
-    * --------------------------------------------------------- */
-   short count = 0;
-   int datalen = 0;
-   while ((datalen = receivePacket()) >0) {
-      if(count > 3) break;
-      if(shtpHeader[2] == CHANNEL_CONTROL
-         && shtpData[0] == PRODUCT_ID_RESPONSE) break;
-      usleep(I2CDELAY);             // Delay 100 microsecs befoer next I2C
-      count++;
+   struct bnocmd c;
+   prodid_request(&c);
+   if(cmd_run(&c) != 0) {
+      printf("Error: Not getting SHTP product-ID reports\n");
+      return(-1);
    }
+   return(prodid_parse(prodlist, &c));
+}
 
-   if(shtpData[0] != PRODUCT_ID_RESPONSE) {
-      printf("Error: Not getting 1st SHTP product-ID report\n");
-      exit(-1);
+/* ------------------------------------------------------------ *
+ * get_frs() - Read sensor metadata from flash into shtpData[]  *
+ * SH-2 reference manual 5.1                                    *
+ * ------------------------------------------------------------ */
+int get_frs(int recid) {
+   struct bnocmd c;
+   cmd_frs(&c, recid);
+   if(cmd_run(&c) != 0) {
+      printf("Error: Not getting SHTP FRS read response\n");
+      return(-1);
    }
-   if(verbose == 1) printf("Debug: OK  1st SHTP product-ID report received, [%d bytes]\n",
-                            datalen);
+   memcpy(shtpData, c.resp[0], c.len[0]);
+   if(verbose == 1) printf("Debug: FRS response report received, [%d bytes]\n",
+                            c.len[0]);
+   return(0);
+}
 
-   /* --------------------------------------------------------- *
-    * Assign 1st product report data to info structure          *
-    * --------------------------------------------------------- */
-   prodlist[0].rep_id  = read8(&shtpData[0]) ;  // report 0xF8 byte 0 Report ID
-   prodlist[0].r_cause = read8(&shtpData[1]);   // report 0xF8 byte 1 Reset Cause
-   prodlist[0].sw_vmaj = read8(&shtpData[2]);   // report 0xF8 byte 2 SW Version Major
-   prodlist[0].sw_vmin = read8(&shtpData[3]);   // report 0xF8 byte 2 SW Version Minor
-   prodlist[0].sw_pnm  = readu32(&shtpData[4]); // report 0xF8 byte 4-7 SW Part Number
-   prodlist[0].sw_bnm  = readu32(&shtpData[8]); // report 0xF8 byte 8-11 SW Build Number
-   prodlist[0].sw_vpn  = read16(&shtpData[12]); // report 0xF8 byte 12-13 SW Version Patch
+/* ------------------------------------------------------------ *
+ * serial_parse() - the serial number is data word 0 of the FRS *
+ * record 0x4B4B, SH-2 reference manual 4.3. An empty record,   *
+ * read status 5, gives serial 0.                               *
+ * ------------------------------------------------------------ */
+static int serial_parse(double *serial, struct bnocmd *c) {
+   uint8_t *d = c->resp[0];
+   if(c->len[0] < 14) return(bno_fail(ERR_PROTO, "Short serial FRS response"));
+   int status = d[1] & 0x0F;
+   if(status == 1 || status == 2 || status == 4 || status == 8) {
+      printf("Error: Serial FRS record read status [%d].\n", status);
+      return(-1);
+   }
+   *serial = (status == 5) ? 0 : readu32(&d[4]);
+   if(verbose == 1) printf("Debug: OK  Serial number [%.0f]\n", *serial);
+   return(0);
+}
 
-   /* --------------------------------------------------------- *
-    * SHTP communication channel 2: read 2nd 0xF8 response      *
-    * --------------------------------------------------------- */
-   usleep(200000);             // Delay 100 microsecs befoer next I2C
-   count = 0;
-   datalen = 0;
-   while ((datalen = receivePacket()) >0) {
-      if(count > 3) break;
-      if(shtpHeader[2] == CHANNEL_CONTROL
-         && shtpData[0] == PRODUCT_ID_RESPONSE) break;
-      usleep(I2CDELAY);                 // Delay 100 microsecs befoer next I2C
-      count++;
+int get_serial(double *serial) {
+   struct bnocmd c;
+   cmd_frs(&c, FRS_SERIAL);
+   if(cmd_run(&c) != 0) {
+      printf("Error: Not getting SHTP FRS read response\n");
+      return(-1);
    }
-      printf("Test %d data-0 %d\n", count, shtpData[0]);
+   return(serial_parse(serial, &c));
+}
 
-   if(shtpData[0] != PRODUCT_ID_RESPONSE) {
-      printf("Error: Not getting 2nd SHTP product-ID report\n");
-      exit(-1);
+/* ------------------------------------------------------------ *
+ * get_info() - the -t inf queries: product ID, calibration     *
+ * state, serial FRS record and error list. All four requests   *
+ * are submitted at once and complete in any order.             *
+ * ------------------------------------------------------------ */
+int get_info(struct prodid prodlist[], struct bnocal *bno_ptr, double *serial) {
+   struct bnocmd c[4];
+   prodid_request(&c[0]);
+   calstat_request(&c[1]);
+   cmd_frs(&c[2], FRS_SERIAL);
+   errlist_request(&c[3]);
+
+   for(int i = 0; i < 4; i++) {
+      if(cmd_submit(&c[i]) != 0) break;
    }
-   if(verbose == 1) printf("Debug: OK  2nd SHTP product-ID report received, [%d bytes]\n",
-                            datalen);
-   /* --------------------------------------------------------- *
-    * Assign 2nd product report data to info structure          *
-    * --------------------------------------------------------- */
-   prodlist[1].rep_id  = read8(&shtpData[0]) ;  // report 0xF8 byte 0 Report ID
-   prodlist[1].r_cause = read8(&shtpData[1]);   // report 0xF8 byte 1 Reset Cause
-   prodlist[1].sw_vmaj = read8(&shtpData[2]);   // report 0xF8 byte 2 SW Version Major
-   prodlist[1].sw_vmin = read8(&shtpData[3]);   // report 0xF8 byte 2 SW Version Minor
-   prodlist[1].sw_pnm  = readu32(&shtpData[4]); // report 0xF8 byte 4-7 SW Part Number
-   prodlist[1].sw_bnm  = readu32(&shtpData[8]); // report 0xF8 byte 8-11 SW Build Number
-   prodlist[1].sw_vpn  = read16(&shtpData[12]); // report 0xF8 byte 12-13 SW Version Patch
+   cmd_wait();
 
+   if(c[0].state != CMD_DONE || prodid_parse(prodlist, &c[0]) != 0) {
+      printf("Error: Cannot read SW version data.\n");
+      return(-1);
+   }
+   if(c[1].state != CMD_DONE || calstat_parse(bno_ptr, &c[1]) != 0) {
+      printf("Error: Cannot read calibration state.\n");
+      return(-1);
+   }
+   if(c[2].state != CMD_DONE || serial_parse(serial, &c[2]) != 0) {
+      printf("Error: Cannot read serial FRS record.\n");
+      return(-1);
+   }
+   if(c[3].state != CMD_DONE) {
+      printf("Error: Cannot read error list.\n");
+      return(-1);
+   }
+   errlist_parse(&c[3]);
    return(0);
 }
 
 /* ------------------------------------------------------------ *
- * get_frs() - Read sensor metadata from flash into shtpData[]  *
- * SH-2 reference manual 5.1                                    *
+ * feature_request() - prepare the Set Feature Command 0xFD for *
+ * report repid at interval usecs with its featureFlags[], done *
+ * by the Get Feature Response 0xFC of that report. SH-2 6.5.4  *
  * ------------------------------------------------------------ */
-int get_frs(int recid) {
+void feature_request(struct bnocmd *c, uint8_t repid, uint32_t interval) {
+   uint8_t req[17] = { 0 };
+   req[0] = SET_FEATURE_COMMAND;
+   req[1] = repid;                          // feature report ID
+   req[2] = featureFlags[repid];            // feature flags
+   req[5] = (interval >> 0) & 0xFF;         // report interval LSB
+   req[6] = (interval >> 8) & 0xFF;
+   req[7] = (interval >> 16) & 0xFF;
+   req[8] = (interval >> 24) & 0xFF;        // report interval MSB
+   if(repid == SENSOR_REPORTID_PER) {
+      req[13] = 0xFF;                       // classify all 9 activities,
+      req[14] = 0x01;                       // SH-2 manual 6.5.36
+   }
+   cmd_init(c, CHANNEL_CONTROL, req, 17, CHANNEL_CONTROL, GET_FEATURE_RESPONSE, 1, OP_FEATURE);
+   c->cmd = repid;                          // response match
+}
+
+/* ------------------------------------------------------------ *
+ * set_feature() - Set Feature Command 0xFD, enables the sensor *
+ * report repid with the given report interval in microseconds. *
+ * An interval of 0 disables the report. SH-2 manual 6.5.4      *
+ * ------------------------------------------------------------ */
+int set_feature(uint8_t repid, uint32_t interval) {
    short count = 0;
-   int datalen = 0;
-   /* --------------------------------------------------------- *
-    * convert recid into LSB and MSB                            *
-    * --------------------------------------------------------- */
-   char lbyte = recid & 0x00FF;
-   char hbyte = recid >> 8;
-   /* --------------------------------------------------------- *
-    * SHTP FRS read request 0xF4 / 0xF3 response CTL Channel 2  *
-    * --------------------------------------------------------- */
-   shtpData[0] = FRS_READ_REQUEST;
-   shtpData[1] = 0x00;
-   shtpData[2] = 0x00;
-   shtpData[3] = 0x00;
-   shtpData[4] = lbyte;
-   shtpData[5] = hbyte;
-   shtpData[6] = 0x00;
-   shtpData[7] = 0x00;
-   sendPacket(CHANNEL_CONTROL, 8);  // Write 8 bytes to CTL channel
+   int found = 0;
+   struct bnocmd c;
+
+   uint64_t start = stats_now();
+   feature_request(&c, repid, interval);
+   memcpy(tx_begin(CHANNEL_CONTROL, 0), c.req, c.reqlen);
+   if(sendPacket(CHANNEL_CONTROL, c.reqlen) != 0) return(-1);
+   featureInterval[repid] = interval; // restored after a recovery
+   wd_expect(repid, interval);      // new --watchdog deadline
    usleep(I2CDELAY);                // Delay 100 microsecs before next I2C
 
-   count = 0;
-   datalen = 0;
-   while ((datalen = receivePacket()) != 0) {
+   /* --------------------------------------------------------- *
+    * The hub confirms with an unsolicited Get Feature Response *
+    * --------------------------------------------------------- */
+   while (sched_recv(0) != 0) {
       if(count > 3) break;
       if(shtpHeader[2] == CHANNEL_CONTROL
-         && shtpData[0] == FRS_READ_RESPONSE) break;
-      usleep(I2CDELAY);              // Delay 100 microsecs before next I2C
+         && shtpData[0] == GET_FEATURE_RESPONSE
+         && shtpData[1] == repid) {
+         found = 1;
+         break;
+      }
+      usleep(I2CDELAY);             // Delay 100 microsecs before next I2C
       count++;
    }
 
-   if(shtpData[0] != FRS_READ_RESPONSE) {
-      printf("Error: Not getting SHTP feature report\n");
-      exit(-1);
+   // shtpData may still hold a response to an earlier request
+   if(found == 0) {
+      if(verbose == 1) printf("Debug: No feature response for report [%02X]\n", repid);
+      return(-1);
    }
-   if(verbose == 1) printf("Debug: FRS response report received, [%d bytes]\n",
-                            datalen);
-   if(verbose == 1) printf("[%02X] [%02X] [%02X] [%02X]\n", shtpData[16],shtpData[17], shtpData[18],shtpData[19]);
-
-   //usleep(10000);
-   //datalen = receivePacket();
-
+   if(verbose == 1) printf("Debug: OK  Report [%02X] interval %u us\n", repid,
+                            readu32(&shtpData[5]));
+   stats_op(OP_FEATURE, start);
    return(0);
 }
 
-int get_serial(double *serial) {
-   int res = get_frs(0xE312);
-   
-   return(res);
+/* ------------------------------------------------------------ *
+ * get_report() - hand out the next report of the last packet,  *
+ * or take the next packet from the scheduler, and if it holds  *
+ * input reports, decode them into the raw sensor globals.      *
+ * Other packets go to the pending requests. Returns one report *
+ * ID per call, or 0 if the packet had no input report.         *
+ * ------------------------------------------------------------ */
+int get_report() {
+   int repid = report_next();
+   if(repid != 0) return(repid);
+
+   int datalen = sched_recv(1);
+   if(datalen == 0) return(0);
+
+   // gyro-integrated rotation vector fast lane, ahead of all else
+   if(shtpHeader[2] == CHANNEL_GYRO) {
+      reptime.age = 0;
+      repid = fast_rx(datalen);
+      reptime.dec = stats_now();
+      return(repid);
+   }
+   // responses to requests submitted while streaming
+   if(shtpHeader[2] != CHANNEL_REPORTS
+      && shtpHeader[2] != CHANNEL_WAKE_REPORTS) {
+      cmd_match(datalen);
+      return(0);
+   }
+   // cargo starts with the 5-byte 0xFB base timestamp
+   if(datalen < 6 || shtpData[0] != GET_TIME_REFERENCE) return(0);
+
+   repid = parseInputReport(datalen);
+   reptime.dec = stats_now();
+   return(repid);
 }
 
 /* ------------------------------------------------------------ *
@@ -654,47 +793,25 @@ int get_serial(double *serial) {
  * ------------------------------------------------------------ */
 int get_acc(struct bnoacc *bnod_ptr) {
    short count = 0;
-   int datalen = 0;
    /* --------------------------------------------------------- *
-    * Check if ACC is already enabled, if not enable it now...  *
+    * Enable the accelerometer report at the default interval   *
     * --------------------------------------------------------- */
-   shtpData[0] = SET_FEATURE_COMMAND;
-   shtpData[1] = 0x01;
-   shtpData[5] = 0x60;
-   shtpData[6] = 0xEA;
-   sendPacket(CHANNEL_CONTROL, 17); // Write 16 bytes to CTL channel
-   usleep(200000);                   // wait 200 millisecs for completion
-
-   datalen = receivePacket();
-   usleep(I2CDELAY);
-
-   shtpData[0] = GET_FEATURE_REQUEST;
-   shtpData[1] = 0x01;
-   sendPacket(CHANNEL_CONTROL, 2); // Write 20 bytes to CTL channel
-   usleep(I2CDELAY);               // Delay 100 msecs before next I2C
-
-   count = 0;
-   datalen = 0;
-   while ((datalen = receivePacket()) != 0) {
-      if(count > 3) break;
-      if(shtpHeader[2] == CHANNEL_CONTROL
-         && shtpData[0] == GET_FEATURE_RESPONSE) break;
-      usleep(I2CDELAY);             // Delay 100 msecs before next I2C
-      count++;
+   if(set_feature(SENSOR_REPORTID_ACC, REPORT_INTERVAL) != 0) {
+      return(bno_fail(ERR_TIMEOUT, "Not getting SHTP feature report"));
    }
 
-   if(shtpData[0] != GET_FEATURE_RESPONSE || 
-      shtpData[1] != 0x01) {
-      printf("Error: Not getting SHTP feature report\n");
-      exit(-1);
+   /* --------------------------------------------------------- *
+    * Wait for the first accelerometer input report             *
+    * --------------------------------------------------------- */
+   while (get_report() != SENSOR_REPORTID_ACC) {
+      if(count > 10) return(1);
+      usleep(REPORT_INTERVAL / 4);
+      count++;
    }
-   if(verbose == 1) printf("Debug: FRS feature report received, [%d bytes]\n",
-                            datalen);
-   if(verbose == 1) printf("[%02X] [%02X] [%02X] [%02X]\n", shtpData[16],shtpData[17], shtpData[18],shtpData[19]);
 
-   if(shtpData[16] == 0x00) return(1);
-   usleep(200000);                   // wait 200 millisecs for completion
-   datalen = receivePacket();
+   bnod_ptr->adata_x = qToFloat(rawAccelX, accelerometer_Q1);
+   bnod_ptr->adata_y = qToFloat(rawAccelY, accelerometer_Q1);
+   bnod_ptr->adata_z = qToFloat(rawAccelZ, accelerometer_Q1);
    return(0);
 }
 
@@ -867,22 +984,113 @@ int print_mode(int mode) {
 }
 
 /* ------------------------------------------------------------ *
- * set_power() - set the sensor power mode in register 0x3E.    *
- * The power modes cannot be switched over directly, first the  *
- * ops mode needs to be "config"  to write the new power mode.  *
+ * set_power() - set the hub power mode through the executable  *
+ * channel, SH-2 reference manual 1.3.1 / SHTP 5.1:             *
+ *   normal  = "on", all enabled reports run                    *
+ *   low     = "sleep", non-wake reports stop, their features   *
+ *             stay configured and resume at the next "on"      *
+ *   suspend = "sleep" and all enabled features turned off, a   *
+ *             later normal or low turns them on again          *
+ * The hub sends no response to on and sleep.                   *
+ * ------------------------------------------------------------ */
+static __thread power_t pwrstate = normal;
+
+/* ------------------------------------------------------------ *
+ * pwr_features() - turn the enabled features off, or back on.  *
+ * featureInterval[] keeps the intervals in both cases.         *
+ * ------------------------------------------------------------ */
+static int pwr_features(int on) {
+   for(int i = 0; i < 256; i++) {
+      if(featureInterval[i] == 0) continue;
+      uint32_t keep = featureInterval[i];
+      if(set_feature(i, on ? keep : 0) != 0) return(-1);
+      featureInterval[i] = keep;
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * pwr_query() - a new process has no featureInterval[] yet, so *
+ * ask the hub which reports run: Get Feature Request 0xFE for  *
+ * each report this program can enable, PWR_QUERY at a time.    *
+ * Running ones go into featureInterval[]. SH-2 manual 6.5.5.   *
+ * Returns the number of running reports, or -1.                *
  * ------------------------------------------------------------ */
+#define PWR_QUERY 8
+
+static int pwr_query() {
+   uint8_t ids[256];
+   int nid = 0, found = 0;
+   for(int id = 1; id < 256; id++) {
+      const struct repdesc *d = report_desc(id);
+      if(d != NULL && (d->decode != NULL || id == SENSOR_REPORTID_GIR)) ids[nid++] = id;
+   }
+   for(int b = 0; b < nid; b += PWR_QUERY) {
+      struct bnocmd c[PWR_QUERY];
+      int n = (nid - b < PWR_QUERY) ? nid - b : PWR_QUERY;
+      for(int i = 0; i < n; i++) {
+         uint8_t req[2] = { GET_FEATURE_REQUEST, ids[b+i] };
+         cmd_init(&c[i], CHANNEL_CONTROL, req, 2, CHANNEL_CONTROL, GET_FEATURE_RESPONSE, 1, OP_FEATURE);
+         c[i].cmd = ids[b+i];                  // response match
+         if(cmd_submit(&c[i]) != 0) return(-1);
+      }
+      if(cmd_wait() != 0) return(-1);
+      for(int i = 0; i < n; i++) {
+         featureInterval[ids[b+i]] = (c[i].len[0] >= 9) ? readu32(&c[i].resp[0][5]) : 0;
+         if(featureInterval[ids[b+i]] > 0) found++;
+      }
+   }
+   if(verbose == 1) printf("Debug: OK  %d reports running on the hub\n", found);
+   return(found);
+}
+
 int set_power(power_t pwrmode) {
+   if(pwrmode == suspend && pwrstate != suspend) {
+      int running = 0;
+      for(int i = 0; i < 256; i++) running += (featureInterval[i] > 0);
+      if(running == 0 && (running = pwr_query()) < 0) return(-1);
+      if(running == 0) printf("No reports are running, suspend only puts the hub to sleep.\n");
+      if(pwr_features(0) != 0) return(-1);
+   }
+
+   uint8_t *tx = tx_begin(CHANNEL_EXECUTABLE, 1);
+   tx[0] = (pwrmode == normal) ? 2 : 3;   // 2 = on, 3 = sleep
+   if(sendPacket(CHANNEL_EXECUTABLE, 1) != 0) return(-1);
+   usleep(I2CDELAY);
+   if(verbose == 1) printf("Debug: OK  Power mode %s\n", (pwrmode == normal) ? "on" : "sleep");
+
+   if(pwrstate == suspend && pwrmode != suspend && pwr_features(1) != 0) return(-1);
+   pwrstate = pwrmode;
    return(0);
 }
 
 /* ------------------------------------------------------------ *
- * get_power() returns the sensor power mode from register 0x3e *
- * Only the lowest 2 bit are used, ignore the unused bits 2-7.  *
+ * get_power() returns the last power mode set on the hub, SH-2 *
+ * has no query for it.                                         *
  * ------------------------------------------------------------ */
 int get_power() {
-   unsigned int data = 0;
-   if(verbose == 1) printf("Debug:     Power Mode: [0x%02X] 2bit [0x%02X]\n", data, data & 0x03);
-   return(data & 0x03);  // only return the lowest 2 bits
+   if(verbose == 1) printf("Debug:     Power Mode: [0x%02X]\n", pwrstate);
+   return(pwrstate);
+}
+
+/* ------------------------------------------------------------ *
+ * pwr_cycle() - duty cycle: put the hub to sleep, wait until   *
+ * the next cycle starts at *next (stats_now() nsecs), and wake *
+ * it up again. *next moves on by period_ms; if it is already   *
+ * past, the cycle starts now. Returns the wake time in nsecs,  *
+ * or 0 if the hub could not be put to sleep or woken up.       *
+ * ------------------------------------------------------------ */
+uint64_t pwr_cycle(uint64_t *next, uint32_t period_ms) {
+   uint64_t now = stats_now();
+   *next += period_ms * 1000000ULL;
+   if(*next <= now) *next = now + period_ms * 1000000ULL;
+
+   if(set_power(low) != 0) return(0);
+   struct timespec ts = { *next / 1000000000ULL, *next % 1000000000ULL };
+   while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+   uint64_t wake = stats_now();
+   if(set_power(normal) != 0) return(0);
+   return(wake);
 }
 
 /* ------------------------------------------------------------ *
@@ -906,80 +1114,10 @@ int print_power(int mode) {
    return(0);
 }
 
-void parseInputReport(int datalen) {
-
-  uint8_t status = shtpData[5 + 2] & 0x03; //Get status bits
-  uint16_t data1 = (uint16_t)shtpData[5 + 5] << 8 | shtpData[5 + 4];
-  uint16_t data2 = (uint16_t)shtpData[5 + 7] << 8 | shtpData[5 + 6];
-  uint16_t data3 = (uint16_t)shtpData[5 + 9] << 8 | shtpData[5 + 8];
-  uint16_t data4 = 0;
-  uint16_t data5 = 0;
-
-  if (datalen - 5 > 9) {
-    data4 = (uint16_t)shtpData[5 + 11] << 8 | shtpData[5 + 10];
-  }
-  if (datalen - 5 > 11) {
-    data5 = (uint16_t)shtpData[5 + 13] << 8 | shtpData[5 + 12];
-  }
-
-  //Store these generic values to their proper global variable
-  if (shtpData[5] == SENSOR_REPORTID_ACC) {
-    accelAccuracy = status;
-    rawAccelX = data1;
-    rawAccelY = data2;
-    rawAccelZ = data3;
-  }
-  else if (shtpData[5] == SENSOR_REPORTID_LIN) {
-    accelLinAccuracy = status;
-    rawLinAccelX = data1;
-    rawLinAccelY = data2;
-    rawLinAccelZ = data3;
-  }
-  else if (shtpData[5] == SENSOR_REPORTID_GYR) {
-    gyroAccuracy = status;
-    rawGyroX = data1;
-    rawGyroY = data2;
-    rawGyroZ = data3;
-  }
-  else if (shtpData[5] == SENSOR_REPORTID_MAG) {
-    magAccuracy = status;
-    rawMagX = data1;
-    rawMagY = data2;
-    rawMagZ = data3;
-  }
-  else if (shtpData[5] == SENSOR_REPORTID_ROT ||
-           shtpData[5] == SENSOR_REPORTID_GAM) {
-    quatAccuracy = status;
-    rawQuatI = data1;
-    rawQuatJ = data2;
-    rawQuatK = data3;
-    rawQuatReal = data4;
-    rawQuatRadianAccuracy = data5; //Only available on rotation vector, not game rot vector
-  }
-  else if (shtpData[5] == SENSOR_REPORTID_STP) {
-    stepCount = data3; //Bytes 8/9
-  }
-  else if (shtpData[5] == SENSOR_REPORTID_STA) {
-    stabilityClassifier = shtpData[5 + 4]; //Byte 4 only
-  }
-  else if (shtpData[5] == SENSOR_REPORTID_PER) {
-    activityClassifier = shtpData[5 + 5]; //Most likely state
-
-    //Load activity classification confidences into the array
-    for (uint8_t x = 0 ; x < 9 ; x++) //Hardcoded to max of 9. TODO - bring in array size
-      _activityConfidences[x] = shtpData[5 + 6 + x]; //5 bytes of timestamp, byte 6 is first confidence byte
-  }
-  else {
-    printf ("Error: sensor report ID [%02X] is unhandled.\n", shtpData[5]);
-  }
-}
-
 //Given a register value and a Q point, convert to float
 //See https://en.wikipedia.org/wiki/Q_(number_format)
 float qToFloat(int16_t fixedPointValue, uint8_t qPoint) {
-   float qFloat = fixedPointValue;
-   qFloat *= pow(2, qPoint * -1);
-   return (qFloat);
+   return (ldexpf(fixedPointValue, -qPoint));
 }
 // rotation vector quaternion I
 float get_quati() {
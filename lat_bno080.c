@@ -0,0 +1,62 @@
+/* ------------------------------------------------------------ *
+ * file:        lat_bno080.c                                    *
+ * purpose:     End-to-end sample latency for --latency. The    *
+ *              hub age of a sample comes from the 0xFB base    *
+ *              timestamp and the report delay field, host time *
+ *              is added for the decode and output stages. Ages *
+ *              go into one histogram per report ID and stage.  *
+ *              Tables print at exit with --latency.            *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "getbno080.h"
+
+// Measuring points: I2C read done, decode done, output done
+#define LAT_STAGES 3
+
+static struct hist *lat[256];   // per report ID, allocated on use
+static const char *lat_stage[LAT_STAGES] = { "read", "decode", "output" };
+
+/* ------------------------------------------------------------ *
+ * lat_add() - record the sample of the last report packet with *
+ * report ID repid, its output completed at out (stats_now()).  *
+ * The hub age counts up to the host interrupt; without it, we  *
+ * take the read completion as that point, so ages are a lower  *
+ * bound by the interrupt-to-read time.                         *
+ * ------------------------------------------------------------ */
+void lat_add(uint8_t repid, uint64_t out) {
+   if(lat[repid] == NULL) {
+      lat[repid] = calloc(LAT_STAGES, sizeof(struct hist));
+      if(lat[repid] == NULL) return;
+   }
+   uint64_t age = (reptime.age > 0) ? reptime.age : 0;
+   hist_add(&lat[repid][0], age);
+   hist_add(&lat[repid][1], age + (reptime.dec - reptime.rx) / 1000);
+   hist_add(&lat[repid][2], age + (out - reptime.rx) / 1000);
+}
+
+/* ------------------------------------------------------------ *
+ * lat_print() - percentile table per report ID and stage       *
+ * ------------------------------------------------------------ */
+void lat_print(FILE *fp) {
+   fprintf(fp, "\nBNO080 sample age, hub sample time to each stage\n");
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Report  Stage        count     min     p50     p99    p999     max (usec)\n");
+   for(int id = 0; id < 256; id++) {
+      if(lat[id] == NULL) continue;
+      const struct repdesc *d = report_desc(id);
+      for(int s = 0; s < LAT_STAGES; s++) {
+         struct hist *h = &lat[id][s];
+         fprintf(fp, "%02X %-4s %-8s %9llu %7llu %7llu %7llu %7llu %7llu\n", id,
+                 (d != NULL) ? d->name : "?", lat_stage[s],
+                 (unsigned long long) h->count, (unsigned long long) h->min,
+                 (unsigned long long) hist_pct(h, 50.0),
+                 (unsigned long long) hist_pct(h, 99.0),
+                 (unsigned long long) hist_pct(h, 99.9),
+                 (unsigned long long) h->max);
+      }
+   }
+}
@@ -0,0 +1,238 @@
+/* ------------------------------------------------------------ *
+ * file:        multi_bno080.c                                  *
+ * purpose:     Multi-bus acquisition for -b with a bus list.   *
+ *              Each bus gets one reader thread, pinned to its  *
+ *              own CPU, that runs the driver on thread-local   *
+ *              sensor state and pushes decoded samples into a  *
+ *              lock-free single producer / single consumer     *
+ *              queue. The calling thread merges the queues     *
+ *              into one stream ordered by the reconstructed    *
+ *              hub sample time.                                *
+ *              Reader threads hand their stats over at end.    *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "getbno080.h"
+
+// Samples per bus queue, a power of 2
+#define MULTI_QLEN    1024
+// Max time the merge waits on an empty bus queue, in usecs
+#define MULTI_HOLD_US 20000
+
+/* ------------------------------------------------------------ *
+ * Bus queue: the reader thread owns head, the merge owns tail. *
+ * Both run free and are masked on access, head == tail means   *
+ * empty. They sit on separate cache lines.                     *
+ * ------------------------------------------------------------ */
+struct bnoqueue{
+   struct bnosample smp[MULTI_QLEN];
+   uint32_t head __attribute__((aligned(64)));
+   uint64_t drops;                       // samples lost to a full queue
+   uint32_t tail __attribute__((aligned(64)));
+};
+
+struct bnodev{
+   char     bus[256];                    // I2C bus device
+   char     addr[8];                     // sensor address in hex
+   int      index;                       // position in the bus list
+   int      live;                        // reader thread is running
+   pthread_t tid;
+   struct bnoqueue q;
+};
+
+static struct bnodev *dev;
+static int ndev = 0;
+static int multi_repid;
+static uint32_t multi_us;
+static int multi_run = 0;
+static struct bnostats *multi_stats;     // stats of the merging thread
+
+/* ------------------------------------------------------------ *
+ * multi_parse() - split the -b list "bus[@addr],bus[@addr],.." *
+ * addr defaults to the -a address. Returns the bus count or -1 *
+ * ------------------------------------------------------------ */
+int multi_parse(char *list, char *defaddr) {
+   char copy[256];
+   strncpy(copy, list, sizeof(copy)-1);
+   copy[sizeof(copy)-1] = '\0';
+
+   dev = calloc(MULTI_MAX, sizeof(struct bnodev));
+   if(dev == NULL) {
+      printf("Error: Cannot allocate the bus queues.\n");
+      return(-1);
+   }
+   ndev = 0;
+   for(char *tok = strtok(copy, ","); tok != NULL; tok = strtok(NULL, ",")) {
+      if(ndev == MULTI_MAX) {
+         printf("Error: more than %d buses in -b list.\n", MULTI_MAX);
+         return(-1);
+      }
+      struct bnodev *d = &dev[ndev];
+      char *at = strchr(tok, '@');
+      if(at != NULL) *at++ = '\0';
+      if(at != NULL && strlen(at) != 4) {
+         printf("Error: Cannot get valid sensor address for bus %s.\n", tok);
+         return(-1);
+      }
+      snprintf(d->bus, sizeof(d->bus), "%s", tok);
+      snprintf(d->addr, sizeof(d->addr), "%s", (at != NULL) ? at : defaddr);
+      d->index = ndev++;
+      if(verbose == 1) printf("Debug: Bus %d [%s] sensor [%s]\n", d->index, d->bus, d->addr);
+   }
+   return(ndev);
+}
+
+/* ------------------------------------------------------------ *
+ * queue_push() - reader side, drops the sample if queue full   *
+ * ------------------------------------------------------------ */
+static void queue_push(struct bnoqueue *q, struct bnosample *smp) {
+   uint32_t head = q->head;
+   if(head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == MULTI_QLEN) {
+      q->drops++;
+      return;
+   }
+   q->smp[head & (MULTI_QLEN - 1)] = *smp;
+   __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* ------------------------------------------------------------ *
+ * queue_peek() - merge side, oldest sample or NULL if empty    *
+ * ------------------------------------------------------------ */
+static struct bnosample *queue_peek(struct bnoqueue *q) {
+   if(__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == q->tail) return(NULL);
+   return(&q->smp[q->tail & (MULTI_QLEN - 1)]);
+}
+
+/* ------------------------------------------------------------ *
+ * multi_reader() - reader thread, one per bus. The driver and  *
+ * sensor globals are thread-local, so this is the single-bus   *
+ * stream loop on its own copy. The sample time is taken back   *
+ * by the hub age of the report, so samples from all buses go   *
+ * on one time base regardless of their read latency.           *
+ * ------------------------------------------------------------ */
+static void *multi_reader(void *arg) {
+   struct bnodev *d = arg;
+   struct bnosample smp;
+
+   long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+   if(ncpu > 1) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(d->index % ncpu, &set);
+      if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0
+         && verbose == 1) printf("Debug: Bus %d cannot pin to CPU %ld\n", d->index, d->index % ncpu);
+   }
+   stats_init(d->bus, d->addr);
+   if(shtp_init(d->bus, d->addr) != 0) {
+      __atomic_store_n(&d->live, 0, __ATOMIC_RELEASE);
+      return(NULL);
+   }
+   if(set_feature(multi_repid, multi_us) != 0) {
+      printf("Error: Cannot enable sensor report [%02X] on %s.\n", multi_repid, d->bus);
+      close(i2cfd);
+      stats_merge(multi_stats);
+      __atomic_store_n(&d->live, 0, __ATOMIC_RELEASE);
+      return(NULL);
+   }
+
+   while(__atomic_load_n(&multi_run, __ATOMIC_RELAXED)) {
+      if(stats.resync) {
+         stats_seq_reset();
+         stats.resyncs++;
+         set_feature(multi_repid, multi_us);
+      }
+      int rid = get_report();
+      if(rid != multi_repid) {
+         usleep(I2CDELAY);
+         continue;
+      }
+      report_sample(&smp, rid);
+      if(reptime.age > 0) smp.ts -= reptime.age;
+      smp.dev = d->index;
+      queue_push(&d->q, &smp);
+   }
+   close(i2cfd);
+   stats_merge(multi_stats);             // counters go to the --stats summary
+   if(verbose == 1) {                    // the trace ring is thread-local too
+      flockfile(stdout);
+      printf("Debug: Bus %d [%s] ", d->index, d->bus);
+      trace_dump(stdout);
+      funlockfile(stdout);
+   }
+   __atomic_store_n(&d->live, 0, __ATOMIC_RELEASE);
+   return(NULL);
+}
+
+/* ------------------------------------------------------------ *
+ * multi_stream() - start one reader per bus, enable report     *
+ * repid at usec interval on each, and pass count samples (0 =  *
+ * endless) in time order to out(smp, arg). With a few buses, a *
+ * scan of the queue heads is the k-way merge. A sample is due  *
+ * when every live queue has one, or once it is MULTI_HOLD_US   *
+ * old, so a stalled bus delays the stream but doesn't stop it. *
+ * ------------------------------------------------------------ */
+int multi_stream(int repid, uint32_t usec, int count,
+                 void (*out)(struct bnosample*, void*), void *arg) {
+   int res = 0, done = 0;
+   multi_repid = repid;
+   multi_us = usec;
+   multi_run = 1;
+   multi_stats = &stats;
+
+   for(int i = 0; i < ndev; i++) {
+      dev[i].live = 1;
+      if(pthread_create(&dev[i].tid, NULL, multi_reader, &dev[i]) != 0) {
+         printf("Error: Cannot start the reader for bus %s.\n", dev[i].bus);
+         dev[i].live = 0;
+         res = -1;
+         break;
+      }
+   }
+
+   while(res == 0 && (count == 0 || done < count)) {
+      struct bnosample *next = NULL;
+      int best = -1, wait = 0, live = 0;
+      for(int i = 0; i < ndev; i++) {
+         int up = __atomic_load_n(&dev[i].live, __ATOMIC_ACQUIRE);
+         struct bnosample *s = queue_peek(&dev[i].q);
+         live += up;
+         if(s == NULL) {
+            wait |= up;                  // may still get an older sample
+            continue;
+         }
+         if(next == NULL || (int32_t) (s->ts - next->ts) < 0) {
+            next = s;
+            best = i;
+         }
+      }
+      if(next == NULL) {
+         if(live == 0) break;            // all readers ended
+         usleep(I2CDELAY);
+         continue;
+      }
+      if(wait && (int32_t) (sink_clock() - next->ts) < MULTI_HOLD_US) {
+         usleep(I2CDELAY);
+         continue;
+      }
+      out(next, arg);
+      __atomic_store_n(&dev[best].q.tail, dev[best].q.tail + 1, __ATOMIC_RELEASE);
+      done++;
+   }
+
+   __atomic_store_n(&multi_run, 0, __ATOMIC_RELAXED);
+   for(int i = 0; i < ndev; i++) {
+      if(dev[i].tid == 0) continue;
+      pthread_join(dev[i].tid, NULL);
+      if(verbose == 1) printf("Debug: Bus %d [%s] %llu samples dropped\n", i, dev[i].bus,
+                               (unsigned long long) dev[i].q.drops);
+   }
+   if(count > 0 && done < count) res = -1;
+   return(res);
+}
@@ -0,0 +1,360 @@
+/* ------------------------------------------------------------ *
+ * file:        out_bno080.c                                    *
+ * purpose:     Buffered output sinks for streamed sensor data. *
+ *              Samples are formatted as CSV, JSON Lines or the *
+ *              fixed-size binary sample into one reusable      *
+ *              buffer, using integer-only Q-point formatting,  *
+ *              and flushed with large write() calls.           *
+ *              The -f fmt[:file] spec is read by sink_open().  *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "getbno080.h"
+
+// Room one formatted record may need at most (text formats),
+// a --sync frame of MULTI_MAX devices is the longest
+#define SINK_RECMAX   320
+// Flush at least this often, so slow rates still reach the reader
+#define SINK_FLUSH_US 250000
+// Decimal places for text output of Q-point report values
+#define SINK_DECIMALS 6
+#define SINK_SCALE    1000000
+
+/* ------------------------------------------------------------ *
+ * sink_clock() - host monotonic time in microseconds, used as  *
+ * record timestamp. Wraps after ~71 minutes, compare with the  *
+ * signed difference (int32_t)(a - b).                          *
+ * ------------------------------------------------------------ */
+uint32_t sink_clock() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return((uint32_t) (ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000));
+}
+
+/* ------------------------------------------------------------ *
+ * fmt_uint() - write unsigned decimal, returns chars written   *
+ * ------------------------------------------------------------ */
+static int fmt_uint(char *p, uint64_t v) {
+   char tmp[20];
+   int n = 0;
+   do {
+      tmp[n++] = '0' + (v % 10);
+      v /= 10;
+   } while(v != 0);
+   for(int i = 0; i < n; i++) p[i] = tmp[n-1-i];
+   return(n);
+}
+
+/* ------------------------------------------------------------ *
+ * fmt_q() - write the Q-point value v * 2^-q with              *
+ * SINK_DECIMALS fixed places. The fraction bits are scaled     *
+ * and rounded with integer math only, there is no float        *
+ * conversion.                                                  *
+ * ------------------------------------------------------------ */
+static int fmt_q(char *p, int16_t v, uint8_t q) {
+   int n = 0;
+   uint32_t x = (v < 0) ? -(int32_t) v : v;
+   if(v < 0) p[n++] = '-';
+
+   uint32_t ip = x >> q;
+   uint64_t frac = x & ((1u << q) - 1);
+   frac = (frac * SINK_SCALE + ((1u << q) >> 1)) >> q;
+   if(frac == SINK_SCALE) {                   // rounded up to 1.0
+      ip++;
+      frac = 0;
+   }
+   n += fmt_uint(&p[n], ip);
+   p[n++] = '.';
+   for(int i = SINK_DECIMALS - 1; i >= 0; i--) {
+      p[n+i] = '0' + (frac % 10);
+      frac /= 10;
+   }
+   return(n + SINK_DECIMALS);
+}
+
+/* ------------------------------------------------------------ *
+ * fmt_str() - copy a constant string, returns chars written    *
+ * ------------------------------------------------------------ */
+static int fmt_str(char *p, const char *s) {
+   int n = strlen(s);
+   memcpy(p, s, n);
+   return(n);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_open() - parse the sink spec "fmt[:file]" and open it.  *
+ * fmt is csv, jsonl or bin. Without file, output goes to stdout*
+ * ------------------------------------------------------------ */
+int sink_open(struct sink *snk, char *spec) {
+   char *file = strchr(spec, ':');
+   int flen = file ? file - spec : (int) strlen(spec);
+
+   if(flen == 3 && strncmp(spec, "csv", 3) == 0) snk->fmt = SINK_CSV;
+   else if(flen == 5 && strncmp(spec, "jsonl", 5) == 0) snk->fmt = SINK_JSONL;
+   else if(flen == 3 && strncmp(spec, "bin", 3) == 0) snk->fmt = SINK_BIN;
+   else {
+      printf("Error: unknown output format [%.*s].\n", flen, spec);
+      return(-1);
+   }
+
+   if(file != NULL && file[1] != '\0') {
+      file++;
+      if((snk->fd = open(file, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+         printf("Error open %s for writing.\n", file);
+         return(-1);
+      }
+   }
+   else {
+      fflush(stdout);
+      snk->fd = STDOUT_FILENO;
+   }
+   if(verbose == 1) printf("Debug: Output sink fmt [%d] fd [%d]\n", snk->fmt, snk->fd);
+
+   snk->len = 0;
+   snk->first = 0;
+   if(snk->fmt == SINK_CSV && snk->frames > 0) {
+      snk->len = fmt_str(snk->buf, "ts,report,mask");
+      for(int d = 0; d < snk->frames; d++)
+         for(int i = 0; i < 4; i++)
+            snk->len += sprintf(snk->buf + snk->len, ",d%dv%d", d, i);
+      snk->buf[snk->len++] = '\n';
+   }
+   else if(snk->fmt == SINK_CSV)
+      snk->len = fmt_str(snk->buf, snk->devcol ? "dev,ts,report,status,v0,v1,v2,v3\n"
+                                               : "ts,report,status,v0,v1,v2,v3\n");
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_flush() - write out the buffer, handles partial writes  *
+ * ------------------------------------------------------------ */
+int sink_flush(struct sink *snk) {
+   size_t done = 0;
+   uint64_t start = stats_now();
+   while(done < snk->len) {
+      ssize_t w = write(snk->fd, snk->buf + done, snk->len - done);
+      if(w < 0) {
+         if(errno == EINTR) continue;
+         printf("Error: output write failure: %s\n", strerror(errno));
+         return(-1);
+      }
+      done += w;
+   }
+   snk->wait_ns += stats_now() - start;  // a slow reader blocks write()
+   snk->len = 0;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_write() - append one sample to the buffer. The buffer   *
+ * is flushed when full, or when its oldest sample gets older   *
+ * than SINK_FLUSH_US.                                          *
+ * ------------------------------------------------------------ */
+int sink_write(struct sink *snk, struct bnosample *smp) {
+   if(snk->len + SINK_RECMAX > SINK_BUFSIZE) {
+      if(sink_flush(snk) != 0) return(-1);
+   }
+   if(snk->len == 0) snk->first = smp->ts;
+
+   char *p = snk->buf + snk->len;
+   int count = SAMPLE_COUNT(smp);
+   int n = 0;
+
+   switch(snk->fmt) {
+      case SINK_CSV:
+         if(snk->devcol) {
+            n += fmt_uint(&p[n], smp->dev);
+            p[n++] = ',';
+         }
+         n += fmt_uint(&p[n], smp->ts);
+         p[n++] = ',';
+         n += fmt_uint(&p[n], smp->repid);
+         p[n++] = ',';
+         n += fmt_uint(&p[n], smp->acc);
+         for(int i = 0; i < 4; i++) {
+            p[n++] = ',';
+            if(i < count) n += fmt_q(&p[n], smp->v[i], smp->q);
+         }
+         p[n++] = '\n';
+         break;
+      case SINK_JSONL:
+         n += fmt_str(&p[n], "{\"ts\":");
+         n += fmt_uint(&p[n], smp->ts);
+         if(snk->devcol) {
+            n += fmt_str(&p[n], ",\"dev\":");
+            n += fmt_uint(&p[n], smp->dev);
+         }
+         n += fmt_str(&p[n], ",\"report\":");
+         n += fmt_uint(&p[n], smp->repid);
+         n += fmt_str(&p[n], ",\"status\":");
+         n += fmt_uint(&p[n], smp->acc);
+         n += fmt_str(&p[n], ",\"v\":[");
+         for(int i = 0; i < count; i++) {
+            if(i > 0) p[n++] = ',';
+            n += fmt_q(&p[n], smp->v[i], smp->q);
+         }
+         n += fmt_str(&p[n], "]}\n");
+         break;
+      case SINK_BIN:
+         memcpy(p, smp, sizeof(struct bnosample));
+         n = sizeof(struct bnosample);
+         break;
+   }
+   snk->len += n;
+
+   if((int32_t) (smp->ts - snk->first) > SINK_FLUSH_US) return(sink_flush(snk));
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_frame() - append one --sync frame, same buffering as    *
+ * sink_write(). Devices missing from the frame mask get empty  *
+ * fields (csv) or null (jsonl).                                *
+ * ------------------------------------------------------------ */
+int sink_frame(struct sink *snk, struct bnoframe *frm) {
+   if(snk->len + SINK_RECMAX > SINK_BUFSIZE) {
+      if(sink_flush(snk) != 0) return(-1);
+   }
+   if(snk->len == 0) snk->first = frm->ts;
+
+   char *p = snk->buf + snk->len;
+   int count = FRAME_COUNT(frm);
+   int n = 0;
+
+   switch(snk->fmt) {
+      case SINK_CSV:
+         n += fmt_uint(&p[n], frm->ts);
+         p[n++] = ',';
+         n += fmt_uint(&p[n], frm->repid);
+         p[n++] = ',';
+         n += fmt_uint(&p[n], frm->mask);
+         for(int d = 0; d < frm->ndev; d++) {
+            for(int i = 0; i < 4; i++) {
+               p[n++] = ',';
+               if(i < count && (frm->mask & (1 << d))) n += fmt_q(&p[n], frm->v[d][i], frm->q);
+            }
+         }
+         p[n++] = '\n';
+         break;
+      case SINK_JSONL:
+         n += fmt_str(&p[n], "{\"ts\":");
+         n += fmt_uint(&p[n], frm->ts);
+         n += fmt_str(&p[n], ",\"report\":");
+         n += fmt_uint(&p[n], frm->repid);
+         n += fmt_str(&p[n], ",\"v\":[");
+         for(int d = 0; d < frm->ndev; d++) {
+            if(d > 0) p[n++] = ',';
+            if((frm->mask & (1 << d)) == 0) {
+               n += fmt_str(&p[n], "null");
+               continue;
+            }
+            p[n++] = '[';
+            for(int i = 0; i < count; i++) {
+               if(i > 0) p[n++] = ',';
+               n += fmt_q(&p[n], frm->v[d][i], frm->q);
+            }
+            p[n++] = ']';
+         }
+         n += fmt_str(&p[n], "]}\n");
+         break;
+      case SINK_BIN:
+         memcpy(p, frm, sizeof(struct bnoframe));
+         n = sizeof(struct bnoframe);
+         break;
+   }
+   snk->len += n;
+
+   if((int32_t) (frm->ts - snk->first) > SINK_FLUSH_US) return(sink_flush(snk));
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sink_close() - flush remaining records, close the file       *
+ * ------------------------------------------------------------ */
+int sink_close(struct sink *snk) {
+   int res = sink_flush(snk);
+   if(snk->fd != STDOUT_FILENO) close(snk->fd);
+   snk->fd = -1;
+   return(res);
+}
+
+/* ------------------------------------------------------------ *
+ * fill_sample() - build a sample from the raw values of the    *
+ * last decoded input report. Returns 0, or -1 for report IDs   *
+ * that have no sample mapping.                                 *
+ * ------------------------------------------------------------ */
+int fill_sample(struct bnosample *smp, int repid) {
+   smp->ts = sink_clock();
+   smp->repid = repid;
+   smp->dev = 0;
+   smp->v[3] = 0;
+
+   switch(repid) {
+      case SENSOR_REPORTID_ACC:
+         smp->acc = accelAccuracy;
+         smp->q = accelerometer_Q1;
+         smp->v[0] = rawAccelX;
+         smp->v[1] = rawAccelY;
+         smp->v[2] = rawAccelZ;
+         break;
+      case SENSOR_REPORTID_GYR:
+         smp->acc = gyroAccuracy;
+         smp->q = gyro_Q1;
+         smp->v[0] = rawGyroX;
+         smp->v[1] = rawGyroY;
+         smp->v[2] = rawGyroZ;
+         break;
+      case SENSOR_REPORTID_MAG:
+         smp->acc = magAccuracy;
+         smp->q = magnetometer_Q1;
+         smp->v[0] = rawMagX;
+         smp->v[1] = rawMagY;
+         smp->v[2] = rawMagZ;
+         break;
+      case SENSOR_REPORTID_LIN:
+         smp->acc = accelLinAccuracy;
+         smp->q = linear_accelerometer_Q1;
+         smp->v[0] = rawLinAccelX;
+         smp->v[1] = rawLinAccelY;
+         smp->v[2] = rawLinAccelZ;
+         break;
+      case SENSOR_REPORTID_ROT:
+      case SENSOR_REPORTID_GAM:
+         smp->acc = quatAccuracy;
+         smp->q = rotationVector_Q1;
+         smp->v[0] = rawQuatI;
+         smp->v[1] = rawQuatJ;
+         smp->v[2] = rawQuatK;
+         smp->v[3] = rawQuatReal;
+         break;
+      case SENSOR_REPORTID_GIR: {
+         // from the fast lane mailbox, timed by the channel 5 read
+         struct gyrosample g;
+         fast_take(&g);
+         smp->ts = (uint32_t) (g.rx / 1000);
+         smp->acc = 0;
+         smp->q = report_desc(SENSOR_REPORTID_GIR)->q;
+         for(int i = 0; i < 4; i++) smp->v[i] = g.q[i];
+         break;
+      }
+      default:
+         return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sample_float() - the sample values as float into f[4], for   *
+ * consumers that need floating point. Returns the value count. *
+ * ------------------------------------------------------------ */
+int sample_float(struct bnosample *smp, float *f) {
+   for(int i = 0; i < 4; i++) f[i] = qToFloat(smp->v[i], smp->q);
+   return(SAMPLE_COUNT(smp));
+}
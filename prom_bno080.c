@@ -0,0 +1,147 @@
+/* ------------------------------------------------------------ *
+ * file:        prom_bno080.c                                   *
+ * purpose:     Metrics export in the Prometheus text format,   *
+ *              for the node exporter textfile collector. The   *
+ *              file is rewritten atomically every few seconds  *
+ *              while streaming: packet counters, sample rates  *
+ *              achieved vs. configured, SHTP errors, accuracy, *
+ *              recovery events and queue depths.               *
+ *              Enabled with --metrics file, last write at stop.*
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "getbno080.h"
+
+// Metrics file rewrite period in millisecs
+#define PROM_PERIOD_MS 5000
+// Text buffer for one metrics file
+#define PROM_BUFSIZE   16384
+
+static char *prom_file = NULL;
+static char prom_buf[PROM_BUFSIZE];
+static uint64_t prom_last = 0;           // last write, stats_now() nsecs
+static uint64_t samples_total[256];      // samples per report ID
+static uint64_t samples_last[256];       // ... at the last write
+static double   samples_rate[256];       // achieved rate in Hz
+
+/* ------------------------------------------------------------ *
+ * prom_start() - export metrics to file, "" or NULL = off      *
+ * ------------------------------------------------------------ */
+void prom_start(char *file) {
+   if(file == NULL || file[0] == '\0') return;
+   prom_file = file;
+   prom_last = stats_now();
+}
+
+/* ------------------------------------------------------------ *
+ * prom_sample() - count one delivered sample of report repid   *
+ * ------------------------------------------------------------ */
+void prom_sample(uint8_t repid) {
+   samples_total[repid]++;
+}
+
+/* ------------------------------------------------------------ *
+ * prom_render() - all metrics as text, qdepth is the number of *
+ * bytes waiting in the output sink. Returns the text length.   *
+ * ------------------------------------------------------------ */
+static int prom_render(char *p, int size, int qdepth) {
+   static const char *dir[2] = { "tx", "rx" };
+   int n = snprintf(p, size, "# HELP bno080_packets_total SHTP packets per channel.\n"
+                             "# TYPE bno080_packets_total counter\n");
+   for(int c = 0; c < SHTP_CHANNELS; c++)
+      for(int d = 0; d < 2 && n < size; d++)
+         n += snprintf(p+n, size-n, "bno080_packets_total{channel=\"%d\",dir=\"%s\"} %llu\n",
+                       c, dir[d], (unsigned long long) stats.chan[c].packets[d]);
+   if(n < size) n += snprintf(p+n, size-n, "# HELP bno080_bytes_total SHTP bytes per channel.\n"
+                                           "# TYPE bno080_bytes_total counter\n");
+   for(int c = 0; c < SHTP_CHANNELS; c++)
+      for(int d = 0; d < 2 && n < size; d++)
+         n += snprintf(p+n, size-n, "bno080_bytes_total{channel=\"%d\",dir=\"%s\"} %llu\n",
+                       c, dir[d], (unsigned long long) stats.chan[c].bytes[d]);
+   if(n < size) n += snprintf(p+n, size-n, "# HELP bno080_packets_lost_total Packets missing in sequence gaps.\n"
+                                           "# TYPE bno080_packets_lost_total counter\n");
+   for(int c = 0; c < SHTP_CHANNELS && n < size; c++)
+      n += snprintf(p+n, size-n, "bno080_packets_lost_total{channel=\"%d\"} %llu\n",
+                    c, (unsigned long long) stats.chan[c].lost);
+
+   /* --------------------------------------------------------- *
+    * Sample rates, per report that is enabled or was delivered *
+    * --------------------------------------------------------- */
+   static const char *family[3][3] = {
+      { "samples_total", "counter", "Samples delivered per report." },
+      { "sample_rate_hz", "gauge", "Sample rate achieved over the last period." },
+      { "sample_rate_configured_hz", "gauge", "Sample rate set on the hub." }
+   };
+   for(int f = 0; f < 3; f++) {
+      if(n < size) n += snprintf(p+n, size-n, "# HELP bno080_%s %s\n# TYPE bno080_%s %s\n",
+                                 family[f][0], family[f][2], family[f][0], family[f][1]);
+      for(int id = 0; id < 256 && n < size; id++) {
+         if(samples_total[id] == 0 && featureInterval[id] == 0) continue;
+         const struct repdesc *d = report_desc(id);
+         double v = (f == 0) ? samples_total[id] : (f == 1) ? samples_rate[id]
+                  : (featureInterval[id] > 0) ? 1e6 / featureInterval[id] : 0.0;
+         n += snprintf(p+n, size-n, "bno080_%s{report=\"%s\"} %.*f\n", family[f][0],
+                       (d != NULL) ? d->name : "unknown", (f == 0) ? 0 : 2, v);
+      }
+   }
+
+   if(n < size) n += prom_shtp(p+n, size-n);
+   if(n < size) n += snprintf(p+n, size-n,
+                    "# HELP bno080_accuracy Report status accuracy bits, 0 unreliable to 3 high.\n"
+                    "# TYPE bno080_accuracy gauge\n"
+                    "bno080_accuracy{sensor=\"acc\"} %d\n"
+                    "bno080_accuracy{sensor=\"lin\"} %d\n"
+                    "bno080_accuracy{sensor=\"gyr\"} %d\n"
+                    "bno080_accuracy{sensor=\"mag\"} %d\n"
+                    "bno080_accuracy{sensor=\"qua\"} %d\n",
+                    accelAccuracy, accelLinAccuracy, gyroAccuracy, magAccuracy, quatAccuracy);
+   if(n < size) n += prom_recov(p+n, size-n);
+   if(n < size) n += prom_wd(p+n, size-n);
+   if(n < size) n += snprintf(p+n, size-n,
+                    "# HELP bno080_resyncs_total Stream resyncs after sequence errors.\n"
+                    "# TYPE bno080_resyncs_total counter\n"
+                    "bno080_resyncs_total %llu\n"
+                    "# HELP bno080_queue_depth Items waiting in host queues.\n"
+                    "# TYPE bno080_queue_depth gauge\n"
+                    "bno080_queue_depth{queue=\"sink_bytes\"} %d\n"
+                    "bno080_queue_depth{queue=\"shtp_requests\"} %d\n",
+                    (unsigned long long) stats.resyncs, qdepth, cmd_pending());
+   return(n < size ? n : size - 1);
+}
+
+/* ------------------------------------------------------------ *
+ * prom_write() - update the rates and publish the metrics file *
+ * ------------------------------------------------------------ */
+static int prom_write(int qdepth) {
+   uint64_t now = stats_now();
+   double secs = (now - prom_last) / 1e9;
+   for(int id = 0; id < 256; id++) {
+      if(secs > 0) samples_rate[id] = (samples_total[id] - samples_last[id]) / secs;
+      samples_last[id] = samples_total[id];
+   }
+   prom_last = now;
+   int len = prom_render(prom_buf, PROM_BUFSIZE, qdepth);
+   return(publish_file(prom_file, prom_buf, len));
+}
+
+/* ------------------------------------------------------------ *
+ * prom_poll() - called from the sampling loop, rewrites the    *
+ * metrics file once PROM_PERIOD_MS has passed.                 *
+ * ------------------------------------------------------------ */
+void prom_poll(int qdepth) {
+   if(prom_file == NULL) return;
+   if(stats_now() - prom_last < PROM_PERIOD_MS * 1000000ULL) return;
+   prom_write(qdepth);
+}
+
+/* ------------------------------------------------------------ *
+ * prom_stop() - write the final metrics at the end of a stream *
+ * ------------------------------------------------------------ */
+void prom_stop(int qdepth) {
+   if(prom_file == NULL) return;
+   prom_write(qdepth);
+   prom_file = NULL;
+}
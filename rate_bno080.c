@@ -0,0 +1,141 @@
+/* ------------------------------------------------------------ *
+ * file:        rate_bno080.c                                   *
+ * purpose:     Demand-driven adaptive report rate controller.  *
+ *              Watches the stability classifier report and     *
+ *              moves the report interval of one sensor between *
+ *              configured bounds with Set Feature commands.    *
+ *              The consumer demand is the -i rate, halved each *
+ *              second the -f sink output blocks in write().    *
+ *              Enabled with -x min:max in stream_reports().    *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdint.h>
+#include "getbno080.h"
+
+// Stability classifier report interval, 100ms is plenty
+#define RATECTL_STA_INTERVAL 100000
+// At-rest classifier reports needed before each slow-down step
+#define RATECTL_HOLD         10
+// Sink backpressure window in millisecs
+#define RATECTL_SINK_MS      1000
+// Percent of the window blocked in write() that halves the demand
+#define RATECTL_SINK_HI      10
+// Percent below which the demand doubles again, up to the -i rate
+#define RATECTL_SINK_LO      1
+
+/* ------------------------------------------------------------ *
+ * ratectl_clamp() - keep an interval inside the configured     *
+ * bounds. The consumer demand is the upper limit for the rate. *
+ * ------------------------------------------------------------ */
+static uint32_t ratectl_clamp(struct ratectl *ctl, uint32_t us) {
+   if(us < ctl->min_us) us = ctl->min_us;
+   if(us > ctl->max_us) us = ctl->max_us;
+   return(us);
+}
+
+/* ------------------------------------------------------------ *
+ * ratectl_set() - send the Set Feature update if it changed    *
+ * ------------------------------------------------------------ */
+static int ratectl_set(struct ratectl *ctl, uint32_t us) {
+   if(us == ctl->cur_us) return(0);
+   if(set_feature(ctl->repid, us) != 0) return(-1);
+   if(verbose == 1) printf("Debug: Rate report [%02X] %u -> %u us\n",
+                            ctl->repid, ctl->cur_us, us);
+   ctl->cur_us = us;
+   ctl->changes++;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * ratectl_init() - start the controlled report at the consumer *
+ * demand rate, and enable the stability classifier it follows. *
+ * ------------------------------------------------------------ */
+int ratectl_init(struct ratectl *ctl, uint8_t repid, uint32_t min_us,
+                 uint32_t max_us, uint32_t demand_us) {
+   if(min_us == 0 || max_us < min_us) {
+      printf("Error: invalid rate bounds %u:%u us\n", min_us, max_us);
+      return(-1);
+   }
+   ctl->repid = repid;
+   ctl->min_us = min_us;
+   ctl->max_us = max_us;
+   ctl->base_us = demand_us;
+   ctl->demand_us = demand_us;
+   ctl->win_start = 0;
+   ctl->cur_us = 0;
+   ctl->still = 0;
+   ctl->hold = RATECTL_HOLD;
+   ctl->changes = 0;
+
+   if(ratectl_set(ctl, ratectl_clamp(ctl, demand_us)) != 0) return(-1);
+   return(set_feature(SENSOR_REPORTID_STA, RATECTL_STA_INTERVAL));
+}
+
+/* ------------------------------------------------------------ *
+ * ratectl_update() - call after a stability classifier report  *
+ * was decoded into stabilityClassifier. Motion or an unknown   *
+ * state restores the demand rate immediately (low latency).    *
+ * At rest, the interval doubles after each "hold" reports, up  *
+ * to max_us. The asymmetric hold is the hysteresis that keeps  *
+ * short pauses or a flapping classifier from toggling rates.   *
+ * ------------------------------------------------------------ */
+int ratectl_update(struct ratectl *ctl) {
+   uint32_t fast = ratectl_clamp(ctl, ctl->demand_us);
+
+   switch(stabilityClassifier) {
+      case STABILITY_ONTABLE:
+      case STABILITY_STATIONARY:
+      case STABILITY_STABLE:
+         if(++ctl->still < ctl->hold) return(0);
+         ctl->still = 0;
+         if(ctl->cur_us >= ctl->max_us) return(0);
+         return(ratectl_set(ctl, ratectl_clamp(ctl, ctl->cur_us * 2)));
+      default:
+         ctl->still = 0;
+         return(ratectl_set(ctl, fast));
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * ratectl_demand() - the consumer asks for report interval     *
+ * demand_us. A slower demand applies now, a faster one with    *
+ * the next motion report, at rest the classifier keeps control.*
+ * ------------------------------------------------------------ */
+int ratectl_demand(struct ratectl *ctl, uint32_t demand_us) {
+   if(demand_us == ctl->demand_us) return(0);
+   if(verbose == 1) printf("Debug: Rate demand report [%02X] %u -> %u us\n",
+                            ctl->repid, ctl->demand_us, demand_us);
+   ctl->demand_us = demand_us;
+   uint32_t us = ratectl_clamp(ctl, demand_us);
+   if(us > ctl->cur_us) return(ratectl_set(ctl, us));
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * ratectl_sink() - demand of the -f sink consumer, call after  *
+ * each sample. Once per RATECTL_SINK_MS window, the share of   *
+ * time blocked in write() halves the demand rate if above      *
+ * RATECTL_SINK_HI percent, or doubles it back towards the -i   *
+ * rate if below RATECTL_SINK_LO. The gap is the hysteresis.    *
+ * ------------------------------------------------------------ */
+int ratectl_sink(struct ratectl *ctl, struct sink *snk) {
+   uint64_t now = stats_now();
+   if(ctl->win_start == 0) {
+      ctl->win_start = now;
+      snk->wait_ns = 0;
+      return(0);
+   }
+   uint64_t span = now - ctl->win_start;
+   if(span < RATECTL_SINK_MS * 1000000ULL) return(0);
+
+   uint64_t pct = snk->wait_ns * 100 / span;
+   uint32_t demand = ctl->demand_us;
+   ctl->win_start = now;
+   snk->wait_ns = 0;
+   if(pct >= RATECTL_SINK_HI && demand < ctl->max_us) demand *= 2;
+   else if(pct < RATECTL_SINK_LO && demand > ctl->base_us) demand /= 2;
+   if(demand < ctl->base_us) demand = ctl->base_us;
+   return(ratectl_demand(ctl, demand));
+}
@@ -0,0 +1,227 @@
+/* ------------------------------------------------------------ *
+ * file:        recov_bno080.c                                  *
+ * purpose:     Self-healing recovery after I2C and SHTP errors.*
+ *              Errors are classified, writes are retried with  *
+ *              backoff, then the state machine re-syncs with   *
+ *              header probes, falls back to a soft reset, and  *
+ *              restores the enabled feature set. The recovery  *
+ *              time is bounded, each path has a counter.       *
+ *              Commands that fail call bno_fail() to recover.  *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "getbno080.h"
+
+// Write retries before the recovery state machine takes over
+#define RECOV_RETRIES   3
+// First retry backoff in microsecs, doubles with each retry
+#define RECOV_BACKOFF   1000
+// Header probes before a probe re-sync is given up
+#define RECOV_PROBES    4
+// Total time budget for one recovery in millisecs
+#define RECOV_BUDGET_MS 3000
+// Errors this soon after a recovery are its after-effects
+#define RECOV_HOLDOFF_MS 100
+
+// Report interval per report ID, as last set by set_feature()
+__thread uint32_t featureInterval[256];
+// Set Feature flags per report ID, FEATURE_WAKE for wake reports
+__thread uint8_t featureFlags[256];
+
+static __thread volatile int in_recovery = 0;
+static __thread uint64_t last_ok = 0;             // end of the last recovery
+static __thread uint64_t last_tmo = 0;            // last timeout fixed by a probe
+static const char *err_name[ERR_COUNT] = { "none", "bus", "short", "protocol", "timeout" };
+static const char *recov_name[RECOV_COUNT] = {
+   "retry", "probe", "reset", "restore", "recovered", "failed"
+};
+
+/* ------------------------------------------------------------ *
+ * bno_classify() - error class of a failed I2C transfer that   *
+ * returned res bytes of the wanted len, with errno value err.  *
+ * ------------------------------------------------------------ */
+bnoerr_t bno_classify(int res, int len, int err) {
+   if(res >= 0 && res < len) return(ERR_SHORT);
+   if(res < 0) return(ERR_BUS);           // EIO, EREMOTEIO, ENXIO...
+   return(ERR_NONE);
+}
+
+/* ------------------------------------------------------------ *
+ * recov_retry() - sleep the backoff for retry number attempt.  *
+ * Returns 0 if one more attempt is allowed, -1 if exhausted.   *
+ * ------------------------------------------------------------ */
+int recov_retry(int attempt) {
+   if(attempt >= RECOV_RETRIES) return(-1);
+   stats.recov[RECOV_RETRY]++;
+   usleep(RECOV_BACKOFF << attempt);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * recov_probe() - re-sync the SHTP stream: read 4-byte headers *
+ * until the hub reports no pending data. Packets announced by  *
+ * a valid header are drained. Returns 0 on sync, -1 on failure.*
+ * ------------------------------------------------------------ */
+static int recov_probe() {
+   uint8_t head[4];
+   for(int i = 0; i < RECOV_PROBES; i++) {
+      usleep(RECOV_BACKOFF << i);
+      if(read(i2cfd, head, 4) != 4) continue;
+
+      int len = (head[1] << 8 | head[0]) & 0x7FFF;
+      if(len == 0x7FFF || head[2] >= SHTP_CHANNELS) continue; // bus noise
+      if(len <= 4) return(0);                // hub idle, we are in sync
+
+      uint8_t drain[len];                    // discard the packet
+      if(read(i2cfd, drain, len) == len) {
+         stats_seq_reset();
+         return(0);
+      }
+   }
+   return(-1);
+}
+
+/* ------------------------------------------------------------ *
+ * recov_restore() - re-enable all features with the interval   *
+ * they had before the error. Returns 0 or -1 on failure.       *
+ * ------------------------------------------------------------ */
+static int recov_restore() {
+   for(int id = 0; id < 256; id++) {
+      if(featureInterval[id] == 0) continue;
+      if(set_feature(id, featureInterval[id]) != 0) return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * bno_recover() - the recovery state machine. Probes the bus   *
+ * first, on failure resets the hub. After a reset, or a probe  *
+ * on a timeout, the enabled features are restored. Steps       *
+ * repeat until RECOV_BUDGET_MS is used up. Returns 0 if the    *
+ * sensor is usable again, -1 if not. Errors during recovery    *
+ * itself do not start a new recovery, the watchdog holds off.  *
+ * ------------------------------------------------------------ */
+int bno_recover(bnoerr_t err) {
+   if(err > ERR_NONE && err < ERR_COUNT) stats.errors[err]++;
+   if(in_recovery) return(-1);
+
+   // a command that was waiting while the last recovery reset
+   // the hub fails as well, that needs no second recovery
+   uint64_t start = stats_now();
+   if(last_ok != 0 && start - last_ok < RECOV_HOLDOFF_MS * 1000000ULL) return(0);
+   in_recovery = 1;
+   wd_hold(1);
+
+   uint64_t deadline = start + RECOV_BUDGET_MS * 1000000ULL;
+   recovstate_t state = RECOV_PROBE;
+   if(verbose == 1) printf("Debug: Recovery start, %s error\n", err_name[err]);
+
+   while(state != RECOV_OK && state != RECOV_FAILED) {
+      if(stats_now() > deadline) {
+         state = RECOV_FAILED;
+         break;
+      }
+      stats.recov[state]++;
+      switch(state) {
+         case RECOV_PROBE:
+            // a timeout may be one lost request: if the hub still
+            // answers the probe, re-send the features instead of a
+            // reset. A second timeout soon after that gets the reset.
+            if(err == ERR_TIMEOUT && last_tmo != 0
+               && start - last_tmo < RECOV_BUDGET_MS * 1000000ULL) state = RECOV_RESET;
+            else if(recov_probe() != 0) state = RECOV_RESET;
+            else if(err == ERR_TIMEOUT) {
+               last_tmo = stats_now();
+               state = RECOV_RESTORE;
+            }
+            else state = RECOV_OK;
+            break;
+         case RECOV_RESET:
+            last_tmo = 0;
+            if(bno_reset() == 0) state = RECOV_RESTORE;
+            else usleep(RECOV_BACKOFF * 10);
+            break;
+         case RECOV_RESTORE:
+            if(recov_restore() == 0) state = RECOV_OK;
+            else state = RECOV_RESET;
+            break;
+         default:
+            state = RECOV_FAILED;
+            break;
+      }
+      if(verbose == 1) printf("Debug: Recovery next state: %s\n", recov_name[state]);
+   }
+
+   stats.recov[state]++;
+   hist_add(&stats.recovtime, (stats_now() - start) / 1000);
+   if(state == RECOV_OK) last_ok = stats_now();
+   in_recovery = 0;
+   wd_hold(0);
+
+   if(state == RECOV_FAILED) {
+      printf("Error: sensor recovery failed after %s error\n", err_name[err]);
+      return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * bno_fail() - a command got no valid response: print the      *
+ * message, run the recovery and return -1 to the caller.       *
+ * ------------------------------------------------------------ */
+int bno_fail(bnoerr_t err, const char *msg) {
+   printf("Error: %s\n", msg);
+   bno_recover(err);
+   return(-1);
+}
+
+/* ------------------------------------------------------------ *
+ * print_recov() - recovery counters for the stats summary      *
+ * ------------------------------------------------------------ */
+void print_recov(FILE *fp) {
+   fprintf(fp, "Errors  :");
+   for(int i = ERR_BUS; i < ERR_COUNT; i++)
+      fprintf(fp, " %s=%llu", err_name[i], (unsigned long long) stats.errors[i]);
+   fprintf(fp, "\nRecovery:");
+   for(int i = 0; i < RECOV_COUNT; i++)
+      fprintf(fp, " %s=%llu", recov_name[i], (unsigned long long) stats.recov[i]);
+   fprintf(fp, "\n");
+}
+
+/* ------------------------------------------------------------ *
+ * json_recov() - recovery counters as JSON object members      *
+ * ------------------------------------------------------------ */
+int json_recov(char *p, int size) {
+   int n = snprintf(p, size, "\"errors\":{");
+   for(int i = ERR_BUS; i < ERR_COUNT && n < size; i++)
+      n += snprintf(p+n, size-n, "%s\"%s\":%llu", (i > ERR_BUS) ? "," : "",
+                    err_name[i], (unsigned long long) stats.errors[i]);
+   if(n < size) n += snprintf(p+n, size-n, "},\"recovery\":{");
+   for(int i = 0; i < RECOV_COUNT && n < size; i++)
+      n += snprintf(p+n, size-n, "%s\"%s\":%llu", i ? "," : "",
+                    recov_name[i], (unsigned long long) stats.recov[i]);
+   if(n < size) n += snprintf(p+n, size-n, "}");
+   return(n);
+}
+
+/* ------------------------------------------------------------ *
+ * prom_recov() - recovery counters in Prometheus text format   *
+ * ------------------------------------------------------------ */
+int prom_recov(char *p, int size) {
+   int n = snprintf(p, size, "# HELP bno080_errors_total I2C errors by class.\n"
+                             "# TYPE bno080_errors_total counter\n");
+   for(int i = ERR_BUS; i < ERR_COUNT && n < size; i++)
+      n += snprintf(p+n, size-n, "bno080_errors_total{class=\"%s\"} %llu\n",
+                    err_name[i], (unsigned long long) stats.errors[i]);
+   if(n < size) n += snprintf(p+n, size-n, "# HELP bno080_recovery_total Recovery steps taken.\n"
+                                           "# TYPE bno080_recovery_total counter\n");
+   for(int i = 0; i < RECOV_COUNT && n < size; i++)
+      n += snprintf(p+n, size-n, "bno080_recovery_total{step=\"%s\"} %llu\n",
+                    recov_name[i], (unsigned long long) stats.recov[i]);
+   return(n);
+}
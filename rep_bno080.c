@@ -0,0 +1,244 @@
+/* ------------------------------------------------------------ *
+ * file:        rep_bno080.c                                    *
+ * purpose:     SH-2 input report table and parser. Each report *
+ *              ID has one compile-time descriptor with length, *
+ *              field layout, signedness and default Q point.   *
+ *              The parser looks up the report by ID, calls its *
+ *              decode function and steps on by the report      *
+ *              length, so all reports in a packet are decoded  *
+ *              and reports we don't store are skipped.         *
+ *              New reports are one entry in reptab[].          *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "getbno080.h"
+
+/* ------------------------------------------------------------ *
+ * rep_vec() - read the fields by the table layout and pass the *
+ * values and the accuracy status bits to the store function.   *
+ * Signed fields are sign-extended, unsigned 16-bit fields keep *
+ * their bits, the store function reads them back as uint16_t.  *
+ * ------------------------------------------------------------ */
+static void rep_vec(const struct repdesc *d, const uint8_t *p) {
+   int16_t v[6];
+   const uint8_t *f = &p[d->off];
+   for(int i = 0; i < d->nval; i++, f += d->width) {
+      uint16_t u = (d->width == 1) ? f[0] : (uint16_t) (f[0] | (f[1] << 8));
+      if(d->sign == 0) v[i] = (int16_t) u;
+      else v[i] = (d->width == 1) ? (int8_t) u : (int16_t) u;
+   }
+   d->store(v, p[2] & 0x03);
+}
+
+/* ------------------------------------------------------------ *
+ * rep_pac() - personal activity classifier: byte 5 is the most *
+ * likely state, followed by the confidence of each activity.   *
+ * SH-2 reference manual 6.5.36                                 *
+ * ------------------------------------------------------------ */
+static void rep_pac(const struct repdesc *d, const uint8_t *p) {
+   activityClassifier = p[5];
+   memcpy(_activityConfidences, &p[d->off], d->nval);
+}
+
+/* ------------------------------------------------------------ *
+ * Store functions, the sensor globals are thread-local and can *
+ * not be pointed to from a static table.                       *
+ * ------------------------------------------------------------ */
+static void st_acc(const int16_t *v, uint8_t s) {
+   rawAccelX = v[0]; rawAccelY = v[1]; rawAccelZ = v[2]; accelAccuracy = s;
+}
+static void st_gyr(const int16_t *v, uint8_t s) {
+   rawGyroX = v[0]; rawGyroY = v[1]; rawGyroZ = v[2]; gyroAccuracy = s;
+}
+static void st_mag(const int16_t *v, uint8_t s) {
+   rawMagX = v[0]; rawMagY = v[1]; rawMagZ = v[2]; magAccuracy = s;
+}
+static void st_lin(const int16_t *v, uint8_t s) {
+   rawLinAccelX = v[0]; rawLinAccelY = v[1]; rawLinAccelZ = v[2]; accelLinAccuracy = s;
+}
+static void st_gra(const int16_t *v, uint8_t s) {
+   rawGravX = v[0]; rawGravY = v[1]; rawGravZ = v[2]; gravAccuracy = s;
+}
+// game rotation vector has no accuracy field, shares the quaternion
+static void st_qua(const int16_t *v, uint8_t s) {
+   rawQuatI = v[0]; rawQuatJ = v[1]; rawQuatK = v[2]; rawQuatReal = v[3];
+   quatAccuracy = s;
+}
+static void st_rot(const int16_t *v, uint8_t s) {
+   st_qua(v, s);
+   rawQuatRadianAccuracy = v[4];
+}
+static void st_geo(const int16_t *v, uint8_t s) {
+   rawGeoI = v[0]; rawGeoJ = v[1]; rawGeoK = v[2]; rawGeoReal = v[3];
+   rawGeoRadianAccuracy = v[4]; geoAccuracy = s;
+}
+static void st_tap(const int16_t *v, uint8_t s) { tapDetector = v[0]; }
+static void st_stp(const int16_t *v, uint8_t s) { stepCount = (uint16_t) v[0]; }
+static void st_sta(const int16_t *v, uint8_t s) { stabilityClassifier = v[0]; }
+
+/* ------------------------------------------------------------ *
+ * The report table, indexed by report ID. IDs without an entry *
+ * have len 0. Lengths and Q points from the SH-2 reference     *
+ * manual, chapter 6.5. Reports without a decode function are   *
+ * known, and skipped.                                          *
+ * ------------------------------------------------------------ */
+#define VEC(store) rep_vec, store
+
+static const struct repdesc reptab[256] = {
+   [SENSOR_REPORTID_ACC] = { "acc", 10, 4, 3, 2, 1,  8, VEC(st_acc) },
+   [SENSOR_REPORTID_GYR] = { "gyr", 10, 4, 3, 2, 1,  9, VEC(st_gyr) },
+   [SENSOR_REPORTID_MAG] = { "mag", 10, 4, 3, 2, 1,  4, VEC(st_mag) },
+   [SENSOR_REPORTID_LIN] = { "lin", 10, 4, 3, 2, 1,  8, VEC(st_lin) },
+   [SENSOR_REPORTID_ROT] = { "qua", 14, 4, 5, 2, 1, 14, VEC(st_rot) },
+   [SENSOR_REPORTID_GRA] = { "gra", 10, 4, 3, 2, 1,  8, VEC(st_gra) },
+   [SENSOR_REPORTID_UGY] = { "ugy", 16, 4, 6, 2, 1,  9, NULL, NULL },
+   [SENSOR_REPORTID_GAM] = { "gam", 12, 4, 4, 2, 1, 14, VEC(st_qua) },
+   [SENSOR_REPORTID_GEO] = { "geo", 14, 4, 5, 2, 1, 14, VEC(st_geo) },
+   [SENSOR_REPORTID_PRS] = { "prs",  8, 4, 1, 4, 0, 20, NULL, NULL },
+   [SENSOR_REPORTID_ALS] = { "als",  8, 4, 1, 4, 0,  8, NULL, NULL },
+   [SENSOR_REPORTID_HUM] = { "hum",  6, 4, 1, 2, 0,  8, NULL, NULL },
+   [SENSOR_REPORTID_PRX] = { "prx",  6, 4, 1, 2, 0,  4, NULL, NULL },
+   [SENSOR_REPORTID_TMP] = { "tmp",  6, 4, 1, 2, 1,  7, NULL, NULL },
+   [SENSOR_REPORTID_UMG] = { "umg", 16, 4, 6, 2, 1,  4, NULL, NULL },
+   [SENSOR_REPORTID_TAP] = { "tap",  5, 4, 1, 1, 0,  0, VEC(st_tap) },
+   [SENSOR_REPORTID_STP] = { "stp", 12, 8, 1, 2, 0,  0, VEC(st_stp) },
+   [SENSOR_REPORTID_SIG] = { "sig",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_STA] = { "sta",  6, 4, 1, 1, 0,  0, VEC(st_sta) },
+   [SENSOR_REPORTID_RAC] = { "rac", 16, 4, 3, 2, 1,  0, NULL, NULL },
+   [SENSOR_REPORTID_RGY] = { "rgy", 16, 4, 4, 2, 1,  0, NULL, NULL },
+   [SENSOR_REPORTID_RMG] = { "rmg", 16, 4, 3, 2, 1,  0, NULL, NULL },
+   [SENSOR_REPORTID_SDT] = { "sdt",  8, 4, 1, 4, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_SHK] = { "shk",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_FLP] = { "flp",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_PCK] = { "pck",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_SDE] = { "sde",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_PER] = { "per", 16, 6, 10, 1, 0, 0, rep_pac, NULL },
+   [SENSOR_REPORTID_SLP] = { "slp",  6, 4, 1, 1, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_TLT] = { "tlt",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_PKT] = { "pkt",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_CIR] = { "cir",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_HRM] = { "hrm",  6, 4, 1, 2, 0,  0, NULL, NULL },
+   [SENSOR_REPORTID_ARV] = { "arv", 14, 4, 5, 2, 1, 14, NULL, NULL },
+   [SENSOR_REPORTID_ARG] = { "arg", 12, 4, 4, 2, 1, 14, NULL, NULL },
+   [SENSOR_REPORTID_GIR] = { "gir", 14, 4, 5, 2, 1, 14, NULL, NULL },
+   [SENSOR_REPORTID_MRQ] = { "mrq",  6, 4, 1, 1, 0,  0, NULL, NULL },
+   // timestamps in report packets, no sensor data
+   [TIME_REBASE]         = { "rbs",  5, 1, 1, 4, 1,  0, NULL, NULL },
+   [GET_TIME_REFERENCE]  = { "bts",  5, 1, 1, 4, 0,  0, NULL, NULL },
+};
+
+/* ------------------------------------------------------------ *
+ * report_desc() - descriptor of report ID id, NULL if unknown  *
+ * ------------------------------------------------------------ */
+const struct repdesc *report_desc(uint8_t id) {
+   return((reptab[id].len == 0) ? NULL : &reptab[id]);
+}
+
+/* ------------------------------------------------------------ *
+ * report_byname() - report ID of the table name, 0 if unknown  *
+ * ------------------------------------------------------------ */
+uint8_t report_byname(const char *name) {
+   for(int id = 1; id < 256; id++)
+      if(reptab[id].len != 0 && strcmp(reptab[id].name, name) == 0) return(id);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * report_qinit() - set the Q point globals to the table values *
+ * ------------------------------------------------------------ */
+void report_qinit() {
+   accelerometer_Q1 = reptab[SENSOR_REPORTID_ACC].q;
+   gyro_Q1 = reptab[SENSOR_REPORTID_GYR].q;
+   magnetometer_Q1 = reptab[SENSOR_REPORTID_MAG].q;
+   linear_accelerometer_Q1 = reptab[SENSOR_REPORTID_LIN].q;
+   rotationVector_Q1 = reptab[SENSOR_REPORTID_ROT].q;
+}
+
+/* ------------------------------------------------------------ *
+ * Sensor reports of the last packet, in packet order. They are *
+ * handed out one per report_next() call, with their own age    *
+ * and the sample built right after their decode.               *
+ * ------------------------------------------------------------ */
+#define REP_QLEN 32
+static __thread struct {
+   uint8_t id;
+   int32_t age;
+   int     res;                          // fill_sample() result
+   struct bnosample smp;
+} repq[REP_QLEN];
+static __thread int repq_n = 0, repq_pos = 0;
+
+/* ------------------------------------------------------------ *
+ * report_next() - the next sensor report of the last packet,   *
+ * sets reptime.age for it. Returns the ID, or 0 when all were  *
+ * handed out.                                                  *
+ * ------------------------------------------------------------ */
+int report_next() {
+   if(repq_pos == repq_n) return(0);
+   reptime.age = repq[repq_pos].age;
+   return(repq[repq_pos++].id);
+}
+
+/* ------------------------------------------------------------ *
+ * report_sample() - the sample of report repid, just returned  *
+ * by get_report(). Reports of the same ID in one packet each   *
+ * keep their own values. Returns 0, or -1 for report IDs that  *
+ * have no sample mapping.                                      *
+ * ------------------------------------------------------------ */
+int report_sample(struct bnosample *smp, int repid) {
+   // the fast lane has its own mailbox, no packet queue
+   if(repid == SENSOR_REPORTID_GIR) return(fill_sample(smp, repid));
+   if(repq_pos == 0 || repq[repq_pos - 1].id != repid) return(-1);
+   *smp = repq[repq_pos - 1].smp;
+   return(repq[repq_pos - 1].res);
+}
+
+/* ------------------------------------------------------------ *
+ * parseInputReport() - decode all reports in the datalen cargo *
+ * bytes of shtpData[] into their globals. The walk stops at an *
+ * unknown ID, its length can't be known. Returns the ID of the *
+ * first sensor report, or 0 if there was none. The later ones  *
+ * follow with report_next().                                   *
+ * ------------------------------------------------------------ */
+int parseInputReport(int datalen) {
+   int pos = 0;
+   int32_t base = 0, rebase = 0;         // 100 usec ticks
+   repq_n = repq_pos = 0;
+
+   while(pos < datalen) {
+      uint8_t *p = &shtpData[pos];
+      const struct repdesc *d = &reptab[p[0]];
+      if(d->len == 0 || pos + d->len > datalen) {
+         if(verbose == 1) printf("Debug: Skip report [%02X] at byte %d of %d\n",
+                                  p[0], pos, datalen);
+         break;
+      }
+      if(p[0] == GET_TIME_REFERENCE) base = (int32_t) readu32(&p[1]);
+      else if(p[0] == TIME_REBASE) rebase = (int32_t) readu32(&p[1]);
+      else if(repq_n < REP_QLEN) {
+         /* ------------------------------------------------------ *
+          * Sample time = interrupt - base + rebase + delay, the   *
+          * 14-bit delay is status bits 7:2 and byte 3. SH-2 6.5.1 *
+          * ------------------------------------------------------ */
+         int32_t delay = ((p[2] & 0xFC) << 6) | p[3];
+         repq[repq_n].age = (base - rebase - delay) * 100;
+         repq[repq_n].id = p[0];
+         if(d->decode != NULL) d->decode(d, p);
+         repq[repq_n].res = fill_sample(&repq[repq_n].smp, p[0]);
+         repq_n++;
+      }
+      else {
+         if(verbose == 1) printf("Debug: Report [%02X] over %d per packet\n", p[0], REP_QLEN);
+         if(d->decode != NULL) d->decode(d, p);
+      }
+      if(p[0] != GET_TIME_REFERENCE && p[0] != TIME_REBASE) {
+         wd_arrival(p[0]);
+         ev_arrival(p[0]);
+      }
+      pos += d->len;
+   }
+   return(report_next());
+}
@@ -0,0 +1,197 @@
+/* ------------------------------------------------------------ *
+ * file:        resamp_bno080.c                                 *
+ * purpose:     Fixed-rate resampler for the rotation vector    *
+ *              stream, --resample. The report spacing jitters  *
+ *              with the hub and bus timing, the resampler puts *
+ *              out quaternions on an exact hz tick. Input      *
+ *              samples are collected until the ticks they span *
+ *              are due, then the batch is interpolated by      *
+ *              normalized lerp, one quaternion per vector.     *
+ *              A tick waits for its next sample up to the      *
+ *              lookahead, then the last sample is held.        *
+ *              Enabled with --resample hz[:msec].              *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "getbno080.h"
+
+// Input samples kept, a power of 2
+#define RS_DEPTH   64
+// Output ticks computed per batch
+#define RS_BATCH   32
+// Default lookahead in msecs
+#define RS_LOOKAHEAD_MS 20
+
+typedef float v4f __attribute__((vector_size(16)));
+
+static v4f      rs_v[RS_DEPTH];          // input quaternions, x y z w
+static uint32_t rs_ts[RS_DEPTH];         // input sample times, usecs
+static uint32_t rs_head = 0;             // samples pushed
+static uint32_t rs_pos = 0;              // oldest sample still needed
+static uint32_t rs_us;                   // tick period
+static uint32_t rs_ahead;                // lookahead in usecs
+static uint32_t rs_tick;                 // next output tick
+static uint8_t  rs_repid, rs_q, rs_acc;
+static void (*rs_out)(struct bnosample*, void*);
+static void *rs_arg;
+
+/* ------------------------------------------------------------ *
+ * Interpolation error. nlerp moves at an uneven angular speed, *
+ * its deviation from SLERP at weight w over the angle th has a *
+ * closed form, so every output gets its exact error.           *
+ * ------------------------------------------------------------ */
+static struct {
+   uint64_t out;                         // ticks put out
+   uint64_t held;                        // ticks past the lookahead
+   double   err_sum;                     // nlerp vs. SLERP, rotation radians
+   double   err_max;
+   double   span_max;                    // widest interpolated angle
+} rs_stat;
+
+/* ------------------------------------------------------------ *
+ * resamp_parse() - "hz[:msec]", the output rate and lookahead  *
+ * ------------------------------------------------------------ */
+int resamp_parse(char *spec) {
+   float hz = 0;
+   int ms = RS_LOOKAHEAD_MS;
+   if(sscanf(spec, "%f:%d", &hz, &ms) < 1 || hz <= 0 || ms < 0) {
+      printf("Error: Cannot get valid --resample hz[:msec] argument.\n");
+      return(-1);
+   }
+   rs_us = (uint32_t) (1000000.0f / hz);
+   rs_ahead = ms * 1000;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * resamp_start() - resampled quaternions go to out(smp, arg)   *
+ * ------------------------------------------------------------ */
+void resamp_start(void (*out)(struct bnosample*, void*), void *arg) {
+   rs_out = out;
+   rs_arg = arg;
+   rs_head = rs_pos = 0;
+   memset(&rs_stat, 0, sizeof(rs_stat));
+   if(verbose == 1) printf("Debug: Resample to %u usec ticks, %u usec lookahead\n",
+                            rs_us, rs_ahead);
+}
+
+/* ------------------------------------------------------------ *
+ * resamp_batch() - put out nt ticks: find the bracketing pair  *
+ * and weight of each tick, then nlerp the whole batch.         *
+ * ------------------------------------------------------------ */
+static void resamp_batch(int nt) {
+   uint8_t ia[RS_BATCH], ib[RS_BATCH];
+   float w[RS_BATCH];
+   v4f res[RS_BATCH];
+
+   for(int k = 0; k < nt; k++) {
+      uint32_t t = rs_tick + k * rs_us;
+      while(rs_pos + 1 < rs_head
+            && (int32_t) (rs_ts[(rs_pos + 1) & (RS_DEPTH - 1)] - t) <= 0) rs_pos++;
+      ia[k] = ib[k] = rs_pos & (RS_DEPTH - 1);
+      w[k] = 0;
+      if(rs_pos + 1 < rs_head) {
+         ib[k] = (rs_pos + 1) & (RS_DEPTH - 1);
+         int32_t da = (int32_t) (t - rs_ts[ia[k]]);
+         int32_t span = (int32_t) (rs_ts[ib[k]] - rs_ts[ia[k]]);
+         if(da > 0 && span > 0) w[k] = (float) da / span;
+      }
+      else if((int32_t) (t - rs_ts[ia[k]]) > 0) rs_stat.held++;
+   }
+
+   for(int k = 0; k < nt; k++) {
+      v4f a = rs_v[ia[k]], b = rs_v[ib[k]];
+      v4f p = a * b;
+      float d = p[0] + p[1] + p[2] + p[3];
+      v4f wb = { w[k], w[k], w[k], w[k] };
+      if(d < 0) {                        // take the short way
+         b = -b;
+         d = -d;
+      }
+      v4f q = a + wb * (b - a);
+      v4f sq = q * q;
+      res[k] = q / sqrtf(sq[0] + sq[1] + sq[2] + sq[3]);
+
+      // th is half the rotation angle, the error doubles to a
+      // rotation angle like the span
+      float th = acosf((d > 1.0f) ? 1.0f : d);
+      double err = 2 * fabs(atan2(w[k] * sinf(th), 1.0f - w[k] + w[k] * cosf(th)) - w[k] * th);
+      rs_stat.err_sum += err;
+      if(err > rs_stat.err_max) rs_stat.err_max = err;
+      if(w[k] > 0 && 2 * th > rs_stat.span_max) rs_stat.span_max = 2 * th;
+   }
+
+   struct bnosample smp;
+   float scale = ldexpf(1.0f, rs_q);
+   smp.repid = rs_repid;
+   smp.q = rs_q;
+   smp.acc = rs_acc;
+   smp.dev = 0;
+   for(int k = 0; k < nt; k++) {
+      smp.ts = rs_tick + k * rs_us;
+      for(int i = 0; i < 4; i++) smp.v[i] = (int16_t) roundf(res[k][i] * scale);
+      rs_out(&smp, rs_arg);
+   }
+   rs_stat.out += nt;
+   rs_tick += nt * rs_us;
+}
+
+/* ------------------------------------------------------------ *
+ * resamp_sample() - take one rotation vector sample. Ticks up  *
+ * to the sample time are due, and ticks more than lookahead    *
+ * behind it if samples are missing.                            *
+ * ------------------------------------------------------------ */
+void resamp_sample(struct bnosample *smp, void *arg) {
+   uint32_t i = rs_head & (RS_DEPTH - 1);
+   float scale = ldexpf(1.0f, -smp->q);
+
+   if(rs_head == 0) rs_tick = smp->ts;
+   if(rs_head - rs_pos == RS_DEPTH) rs_pos++;  // drop the oldest
+   for(int a = 0; a < 4; a++) rs_v[i][a] = smp->v[a] * scale;
+   rs_ts[i] = smp->ts;
+   rs_head++;
+   rs_repid = smp->repid;
+   rs_q = smp->q;
+   rs_acc = smp->acc;
+
+   /* --------------------------------------------------------- *
+    * The newest sample brackets all ticks up to its time. If   *
+    * it came late, ticks before its previous sample plus the   *
+    * lookahead were held already, the rest is interpolated.    *
+    * --------------------------------------------------------- */
+   while((int32_t) (smp->ts - rs_tick) >= 0) {
+      int nt = (int32_t) (smp->ts - rs_tick) / rs_us + 1;
+      resamp_batch((nt > RS_BATCH) ? RS_BATCH : nt);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * resamp_poll() - called while waiting for samples: ticks that *
+ * are older than the lookahead hold the last sample            *
+ * ------------------------------------------------------------ */
+void resamp_poll(uint32_t now) {
+   if(rs_head == 0) return;
+   while((int32_t) (now - rs_ahead - rs_tick) >= 0) {
+      int nt = (int32_t) (now - rs_ahead - rs_tick) / rs_us + 1;
+      resamp_batch((nt > RS_BATCH) ? RS_BATCH : nt);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * resamp_print() - resampler statistics for --stats            *
+ * ------------------------------------------------------------ */
+void resamp_print(FILE *fp) {
+   fprintf(fp, "\nBNO080 resampler, %.1f Hz output, %u ms lookahead\n",
+           1000000.0 / rs_us, rs_ahead / 1000);
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Samples in %llu, ticks out %llu, held past lookahead %llu\n",
+           (unsigned long long) rs_head, (unsigned long long) rs_stat.out,
+           (unsigned long long) rs_stat.held);
+   fprintf(fp, "nlerp error vs. SLERP: mean %.6f max %.6f deg, widest span %.3f deg\n",
+           (rs_stat.out > 0) ? rs_stat.err_sum / rs_stat.out * 180 / M_PI : 0.0,
+           rs_stat.err_max * 180 / M_PI, rs_stat.span_max * 180 / M_PI);
+}
@@ -0,0 +1,242 @@
+/* ------------------------------------------------------------ *
+ * file:        sched_bno080.c                                  *
+ * purpose:     Receive scheduler across the SHTP channels. All *
+ *              loops that wait for packets go through it. A    *
+ *              control wait (FRS, commands, feature responses) *
+ *              keeps the input reports it reads in per-channel *
+ *              queues instead of dropping them. The report     *
+ *              consumer then picks its next action: drain the  *
+ *              queued reports by priority and deadline, send a *
+ *              deferred control request when there is slack    *
+ *              before the next report, or poll the bus.        *
+ *              Channel 5 is not queued, its packets go to the  *
+ *              fast lane mailbox right away (fast_bno080.c).   *
+ *              sched_recv() is the single packet wait loop.    *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "getbno080.h"
+
+// Report packets kept per channel, a power of 2
+#define SCHED_QLEN   32
+// Largest report packet cargo kept, larger ones are dropped
+#define SCHED_PKTMAX 256
+// Deferred control requests
+#define SCHED_DEFER  4
+// Time a control request needs on the bus, in usecs
+#define SCHED_ISSUE_US 1000
+
+typedef enum {
+   SCHED_DRAIN = 0x00,   // queued report to the consumer
+   SCHED_ISSUE = 0x01,   // deferred control request sent
+   SCHED_POLL  = 0x02,   // next packet read from the bus
+   SCHED_COUNT
+} schedact_t;
+
+/* ------------------------------------------------------------ *
+ * Channel table. Higher prio drains first, unless a packet of  *
+ * another channel is past its deadline. A control request may  *
+ * wait for slack up to the control channel deadline.           *
+ * ------------------------------------------------------------ */
+struct schedchan{
+   uint8_t  prio;                        // 0 = lowest
+   uint32_t deadline;                    // max queue time in usecs
+   uint32_t head, tail;                  // queue positions, run free
+   uint64_t queued;                      // packets kept in a control wait
+   uint64_t drained;                     // queued packets delivered
+   uint64_t late;                        // delivered past the deadline
+   uint64_t drops;                       // lost to a full queue or size
+   uint32_t maxocc;                      // highest queue occupancy
+};
+
+struct schedpkt{
+   uint64_t rx;                          // read time, stats_now() nsecs
+   uint8_t  head[4];                     // SHTP header
+   uint16_t len;                         // cargo length
+   uint8_t  data[SCHED_PKTMAX];
+};
+
+static __thread struct schedchan chan[SHTP_CHANNELS] = {
+   [CHANNEL_COMMAND]      = { 0, 1000000 },
+   [CHANNEL_EXECUTABLE]   = { 0, 1000000 },
+   [CHANNEL_CONTROL]      = { 1,  100000 },
+   [CHANNEL_REPORTS]      = { 3,   10000 },
+   [CHANNEL_WAKE_REPORTS] = { 2,   50000 },
+};
+static __thread struct schedpkt queue[SHTP_CHANNELS][SCHED_QLEN];
+static __thread struct bnocmd *defer[SCHED_DEFER];
+static __thread int ndefer = 0;
+static __thread uint64_t defer_start;    // oldest deferred request
+static __thread uint64_t last_rx = 0;    // last report packet read
+static __thread uint64_t actions[SCHED_COUNT];
+static const char *sched_act[SCHED_COUNT] = { "drain", "issue", "poll" };
+
+static int report_chan(int c) {
+   return(c == CHANNEL_REPORTS || c == CHANNEL_WAKE_REPORTS);
+}
+
+/* ------------------------------------------------------------ *
+ * sched_keep() - queue the report packet just read, the oldest *
+ * one goes if the queue is full                                *
+ * ------------------------------------------------------------ */
+static void sched_keep(int datalen) {
+   struct schedchan *c = &chan[shtpHeader[2]];
+   if(datalen > SCHED_PKTMAX) {
+      c->drops++;
+      return;
+   }
+   if(c->head - c->tail == SCHED_QLEN) {
+      c->tail++;
+      c->drops++;
+   }
+   struct schedpkt *p = &queue[shtpHeader[2]][c->head & (SCHED_QLEN - 1)];
+   p->rx = last_rx;
+   memcpy(p->head, shtpHeader, 4);
+   memcpy(p->data, shtpData, datalen);
+   p->len = datalen;
+   c->head++;
+   c->queued++;
+   if(c->head - c->tail > c->maxocc) c->maxocc = c->head - c->tail;
+}
+
+/* ------------------------------------------------------------ *
+ * sched_pick() - channel of the next queued report, -1 if all  *
+ * queues are empty. The most overdue packet first, else the    *
+ * highest priority.                                            *
+ * ------------------------------------------------------------ */
+static int sched_pick(uint64_t now) {
+   int best = -1;
+   int64_t over = 0;
+   for(int i = 0; i < SHTP_CHANNELS; i++) {
+      struct schedchan *c = &chan[i];
+      if(c->head == c->tail) continue;
+      int64_t late = (int64_t) (now - queue[i][c->tail & (SCHED_QLEN - 1)].rx)
+                   - c->deadline * 1000LL;
+      if(best < 0 || (late > 0 && late > over)
+         || (over <= 0 && late <= 0 && c->prio > chan[best].prio)) {
+         best = i;
+         over = late;
+      }
+   }
+   return(best);
+}
+
+/* ------------------------------------------------------------ *
+ * sched_slack() - 1 if a control request fits before the next  *
+ * report is due, or the oldest request waited its deadline.    *
+ * ------------------------------------------------------------ */
+static int sched_slack(uint64_t now) {
+   if(now - defer_start > chan[CHANNEL_CONTROL].deadline * 1000ULL) return(1);
+   uint32_t period = 0;
+   for(int id = 0; id < 256; id++)
+      if(featureInterval[id] > 0 && (period == 0 || featureInterval[id] < period))
+         period = featureInterval[id];
+   if(period == 0 || last_rx == 0) return(1);
+   uint64_t next = last_rx + period * 1000ULL;
+   return(now + SCHED_ISSUE_US * 1000ULL < next);
+}
+
+/* ------------------------------------------------------------ *
+ * sched_issue() - send the oldest deferred request, completed  *
+ * later by cmd_match() in get_report()                         *
+ * ------------------------------------------------------------ */
+static void sched_issue(uint64_t now) {
+   struct bnocmd *c = defer[0];
+   memmove(&defer[0], &defer[1], (--ndefer) * sizeof(defer[0]));
+   defer_start = now;
+   if(cmd_submit(c) != 0 && verbose == 1)
+      printf("Debug: Deferred request [%02X] send failed\n", c->req[0]);
+}
+
+/* ------------------------------------------------------------ *
+ * sched_recv() - receivePacket() for all waiting loops, the    *
+ * return is the cargo length of the packet in shtpHeader and   *
+ * shtpData, or 0. reports = 0 for a control wait: the input    *
+ * reports are queued, channel 5 packets go to fast_rx(), and   *
+ * the wait only gets other packets.                            *
+ * reports = 1 for the report consumer: queued reports come     *
+ * first, then a deferred request if there is slack, then the   *
+ * next packet on the bus. reptime.rx is set to the read time.  *
+ * ------------------------------------------------------------ */
+int sched_recv(int reports) {
+   if(reports == 0) {
+      for(int n = 0; n < SCHED_QLEN; n++) {
+         int datalen = receivePacket();
+         if(datalen == 0) return(0);
+         if(shtpHeader[2] == CHANNEL_GYRO) {
+            // fast lane: publish now, the consumer takes the newest
+            uint64_t rx = reptime.rx;
+            reptime.rx = last_rx = stats_now();
+            fast_rx(datalen);
+            reptime.rx = rx;
+            continue;
+         }
+         if(report_chan(shtpHeader[2]) == 0) return(datalen);
+         last_rx = stats_now();
+         sched_keep(datalen);
+      }
+      return(0);
+   }
+
+   uint64_t now = stats_now();
+   cmd_expire();
+   int i = sched_pick(now);
+   if(i >= 0) {
+      struct schedchan *c = &chan[i];
+      struct schedpkt *p = &queue[i][c->tail & (SCHED_QLEN - 1)];
+      memcpy(shtpHeader, p->head, 4);
+      memcpy(shtpData, p->data, p->len);
+      reptime.rx = p->rx;
+      c->tail++;
+      c->drained++;
+      if(now - p->rx > c->deadline * 1000ULL) c->late++;
+      actions[SCHED_DRAIN]++;
+      return(p->len);
+   }
+   if(ndefer > 0 && sched_slack(now)) {
+      sched_issue(now);
+      actions[SCHED_ISSUE]++;
+   }
+   actions[SCHED_POLL]++;
+   int datalen = receivePacket();
+   reptime.rx = stats_now();
+   if(datalen > 0 && (report_chan(shtpHeader[2]) || shtpHeader[2] == CHANNEL_GYRO))
+      last_rx = reptime.rx;
+   return(datalen);
+}
+
+/* ------------------------------------------------------------ *
+ * sched_defer() - queue request c, it is sent by the report    *
+ * consumer when no report is due. c stays CMD_PENDING until    *
+ * its response. Returns 0, or -1 if the queue is full.         *
+ * ------------------------------------------------------------ */
+int sched_defer(struct bnocmd *c) {
+   if(ndefer == SCHED_DEFER) return(-1);
+   if(ndefer == 0) defer_start = stats_now();
+   c->state = CMD_PENDING;
+   defer[ndefer++] = c;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * sched_print() - channel queues and actions for --stats       *
+ * ------------------------------------------------------------ */
+void sched_print(FILE *fp) {
+   fprintf(fp, "\nBNO080 receive scheduler, reports queued during control waits\n");
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Chan prio deadline(us)   queued  drained     late    drops  max occ\n");
+   for(int i = 0; i < SHTP_CHANNELS; i++) {
+      struct schedchan *c = &chan[i];
+      if(report_chan(i) == 0) continue;
+      fprintf(fp, "%4d %4d %12u %8llu %8llu %8llu %8llu %8u\n", i, c->prio, c->deadline,
+              (unsigned long long) c->queued, (unsigned long long) c->drained,
+              (unsigned long long) c->late, (unsigned long long) c->drops, c->maxocc);
+   }
+   fprintf(fp, "Actions:");
+   for(int a = 0; a < SCHED_COUNT; a++)
+      fprintf(fp, " %s %llu", sched_act[a], (unsigned long long) actions[a]);
+   fprintf(fp, "\n");
+}
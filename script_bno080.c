@@ -0,0 +1,209 @@
+/* ------------------------------------------------------------ *
+ * file:        script_bno080.c                                 *
+ * purpose:     Batch command scripts for -s. One session runs  *
+ *              a list of operations, one per line, on a single *
+ *              bus open and SHTP init. Each step writes one    *
+ *              JSON line with its status and duration, sample  *
+ *              reads add one JSON line per sample before it.   *
+ *              The script stops at the first failing step.     *
+ *              Runs one -s script file, see script_run().      *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "getbno080.h"
+
+// Max words of a FRS record read or written by a script step
+#define SCRIPT_FRSMAX 256
+// Max arguments of one script line
+#define SCRIPT_ARGS   (SCRIPT_FRSMAX + 2)
+// Min time to wait for one sample of a read step, in msecs
+#define SCRIPT_WAIT_MS 1000
+
+static struct sink script_snk;
+static uint32_t script_us;               // -i interval for read steps
+
+/* ------------------------------------------------------------ *
+ * Step output: op_begin() starts the JSON line, the step adds  *
+ * its fields, op_end() closes it with status and duration.     *
+ * ------------------------------------------------------------ */
+static void op_begin(int step, char *op) {
+   printf("{\"step\":%d,\"op\":\"%s\"", step, op);
+}
+
+static int op_end(int res, uint64_t start) {
+   printf(",\"status\":\"%s\",\"ms\":%.1f}\n", (res == 0) ? "ok" : "error",
+          (stats_now() - start) / 1e6);
+   fflush(stdout);
+   return(res);
+}
+
+static void json_cal(struct bnocal *c) {
+   printf(",\"cal\":{\"acc\":%d,\"gyr\":%d,\"mag\":%d,\"planar\":%d}",
+          c->acal_st, c->gcal_st, c->mcal_st, c->pcal_st);
+}
+
+/* ------------------------------------------------------------ *
+ * op_info() - the -t inf queries: versions, calibration state  *
+ * and the serial number                                        *
+ * ------------------------------------------------------------ */
+static int op_info() {
+   struct prodid prodlist[2];
+   struct bnocal bnoc;
+   double serial;
+   if(get_info(prodlist, &bnoc, &serial) != 0) return(-1);
+   printf(",\"parts\":[");
+   for(int i = 0; i < ARRAY_ITEMS(prodlist); i++)
+      printf("%s{\"part\":%u,\"version\":\"%d.%d.%d\",\"build\":%u,\"reset\":%d}",
+             (i > 0) ? "," : "", prodlist[i].sw_pnm, prodlist[i].sw_vmaj,
+             prodlist[i].sw_vmin, prodlist[i].sw_vpn, prodlist[i].sw_bnm,
+             prodlist[i].r_cause);
+   printf("]");
+   json_cal(&bnoc);
+   printf(",\"serial\":%.0f", serial);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * op_read() - read count samples of report id, enabled at the  *
+ * -i interval if it is off. Samples go out as JSON lines, the  *
+ * number read is returned in done.                             *
+ * ------------------------------------------------------------ */
+static int op_read(uint8_t id, int count, int *done) {
+   struct bnosample smp;
+   if(featureInterval[id] == 0 && set_feature(id, script_us) != 0) return(-1);
+   uint32_t period = featureInterval[id];
+
+   *done = 0;
+   uint64_t wait = (SCRIPT_WAIT_MS * 1000ULL > 10ULL * period)
+                 ? SCRIPT_WAIT_MS * 1000000ULL : 10000ULL * period;
+   uint64_t last = stats_now();
+   while(*done < count) {
+      if(get_report() != id) {
+         if(stats_now() - last > wait) break;
+         usleep(I2CDELAY);
+         continue;
+      }
+      last = stats_now();
+      if(report_sample(&smp, id) != 0) break;
+      if(sink_write(&script_snk, &smp) != 0) break;
+      (*done)++;
+   }
+   if(sink_flush(&script_snk) != 0) return(-1);
+   return((*done == count) ? 0 : -1);
+}
+
+/* ------------------------------------------------------------ *
+ * op_frs() - FRS record read (argc 2), or write of the words   *
+ * given after the record type                                  *
+ * ------------------------------------------------------------ */
+static int op_frs(int write, int argc, char **argv) {
+   uint32_t words[SCRIPT_FRSMAX];
+   uint16_t recid = strtol(argv[1], NULL, 16);
+   printf(",\"record\":\"%04X\"", recid);
+   if(write) {
+      int n = argc - 2;
+      for(int i = 0; i < n; i++) words[i] = strtoul(argv[2+i], NULL, 16);
+      printf(",\"count\":%d", n);
+      return(frs_write(recid, words, n));
+   }
+   int n = frs_read(recid, words, SCRIPT_FRSMAX);
+   if(n < 0) return(-1);
+   printf(",\"words\":[");
+   for(int i = 0; i < n; i++) printf("%s\"%08X\"", (i > 0) ? "," : "", words[i]);
+   printf("]");
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * script_step() - run one parsed script line, returns 0 or -1  *
+ * ------------------------------------------------------------ */
+static int script_step(int step, int argc, char **argv) {
+   char *op = argv[0];
+   uint64_t start = stats_now();
+   int res = -1, done = 0;
+   uint8_t id;
+
+   // the samples of a read step go out first, its step line after
+   if(strcmp(op, "read") == 0 && argc == 3 && (id = report_byname(argv[1])) != 0) {
+      res = (atoi(argv[2]) > 0) ? op_read(id, atoi(argv[2]), &done) : -1;
+      op_begin(step, op);
+      printf(",\"report\":%d,\"count\":%d", id, done);
+      return(op_end(res, start));
+   }
+
+   op_begin(step, op);
+
+   if(strcmp(op, "info") == 0 && argc == 1) res = op_info();
+   else if(strcmp(op, "calstat") == 0 && argc == 1) {
+      struct bnocal bnoc;
+      if((res = get_calstat(&bnoc)) == 0) json_cal(&bnoc);
+   }
+   else if(strcmp(op, "feature") == 0 && argc == 3) {
+      id = report_byname(argv[1]);
+      printf(",\"report\":%d,\"interval\":%d", id, atoi(argv[2]));
+      if(id != 0) res = set_feature(id, atoi(argv[2]));
+   }
+   else if(strcmp(op, "frs-read") == 0 && argc == 2) res = op_frs(0, argc, argv);
+   else if(strcmp(op, "frs-write") == 0 && argc > 2) res = op_frs(1, argc, argv);
+   else if(strcmp(op, "save-cal") == 0 && argc == 2) res = save_cal(argv[1]);
+   else if(strcmp(op, "load-cal") == 0 && argc == 2) res = load_cal(argv[1]);
+   else if(strcmp(op, "reset") == 0 && argc == 1) res = bno_reset();
+   else if(strcmp(op, "power") == 0 && argc == 2) {
+      if(strcmp(argv[1], "normal") == 0) res = set_power(normal);
+      else if(strcmp(argv[1], "low") == 0) res = set_power(low);
+      else if(strcmp(argv[1], "suspend") == 0) res = set_power(suspend);
+   }
+   else if(strcmp(op, "sleep") == 0 && argc == 2) {
+      usleep(atoi(argv[1]) * 1000);
+      res = 0;
+   }
+   else printf(",\"error\":\"unknown op or arguments\"");
+   return(op_end(res, start));
+}
+
+/* ------------------------------------------------------------ *
+ * script_run() - run the script in file, "-" reads stdin. The  *
+ * read step enables a report at usec if it is off. Ops:        *
+ *   info                    versions, calibration, serial      *
+ *   calstat                 calibration enable flags           *
+ *   feature <rep> <usec>    enable report, 0 usec = off        *
+ *   read <rep> <count>      read samples, report names as in   *
+ *                           the report table (acc, gyr, qua..) *
+ *   frs-read <hex>          read FRS record                    *
+ *   frs-write <hex> <w>..   write FRS record, hex words        *
+ *   save-cal <file>         save the DCD, copy to file         *
+ *   load-cal <file>         write the DCD file, reset          *
+ *   reset                   reset the hub                      *
+ *   power normal|low|suspend                                   *
+ *   sleep <msec>                                               *
+ * Empty lines and lines starting with # are skipped. Returns 0 *
+ * if all steps succeeded, -1 at the first failing step.        *
+ * ------------------------------------------------------------ */
+int script_run(char *file, uint32_t usec) {
+   char line[4096];
+   char *argv[SCRIPT_ARGS];
+   int step = 0, res = 0;
+   script_us = usec;
+
+   FILE *fp = (strcmp(file, "-") == 0) ? stdin : fopen(file, "r");
+   if(fp == NULL) {
+      printf("Error open %s for reading.\n", file);
+      return(-1);
+   }
+   if(sink_open(&script_snk, "jsonl") != 0) return(-1);
+
+   while(res == 0 && fgets(line, sizeof(line), fp) != NULL) {
+      int argc = 0;
+      for(char *tok = strtok(line, " \t\r\n"); tok != NULL && argc < SCRIPT_ARGS;
+          tok = strtok(NULL, " \t\r\n")) argv[argc++] = tok;
+      if(argc == 0 || argv[0][0] == '#') continue;
+      res = script_step(++step, argc, argv);
+   }
+   if(fp != stdin) fclose(fp);
+   if(verbose == 1) printf("Debug: Script %s, %d steps\n", (res == 0) ? "done" : "failed", step);
+   return(res);
+}
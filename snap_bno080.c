@@ -0,0 +1,255 @@
+/* ------------------------------------------------------------ *
+ * file:        snap_bno080.c                                   *
+ * purpose:     Periodic HTML/JSON snapshot writer for the web  *
+ *              dashboard. The sampling loop only stores the    *
+ *              latest sample per report under a sequence lock. *
+ *              A writer thread renders every N ms into a       *
+ *              double buffer and publishes via a temp file and *
+ *              rename(), so readers never see a torn file.     *
+ *              Enabled with -u msec, -o and -j name the files. *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include "getbno080.h"
+
+// Different report IDs a snapshot can hold
+#define SNAP_SLOTS   8
+// Render buffer size per output file
+#define SNAP_BUFSIZE 4096
+// Max length of the temporary file path
+#define SNAP_PATHLEN 512
+
+/* ------------------------------------------------------------ *
+ * Latest sample per report ID, written by the sampling loop.   *
+ * seq is odd while an update is in progress (sequence lock).   *
+ * ------------------------------------------------------------ */
+static struct {
+   uint32_t seq;
+   int count;
+   struct bnosample smp[SNAP_SLOTS];
+} snap;
+
+/* ------------------------------------------------------------ *
+ * Writer thread state. Each output has two render buffers, the *
+ * published one is kept to skip rewriting unchanged content.   *
+ * ------------------------------------------------------------ */
+struct snapfile {
+   char *file;                   // destination file, NULL = off
+   char buf[2][SNAP_BUFSIZE];    // double buffer
+   int  len[2];                  // rendered bytes per buffer
+   int  cur;                     // buffer holding published data
+};
+static struct snapfile snap_htm, snap_jsn;
+static pthread_t snap_thread;
+static int snap_period;          // render period in millisecs
+static volatile int snap_run;    // writer thread keeps running
+
+/* ------------------------------------------------------------ *
+ * snap_update() - store the latest sample of its report ID.    *
+ * Called from the sampling loop, never blocks.                 *
+ * ------------------------------------------------------------ */
+void snap_update(struct bnosample *smp) {
+   int i;
+   for(i = 0; i < snap.count; i++) {
+      if(snap.smp[i].repid == smp->repid) break;
+   }
+   if(i == SNAP_SLOTS) return;
+
+   __atomic_add_fetch(&snap.seq, 1, __ATOMIC_RELEASE);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   snap.smp[i] = *smp;
+   if(i == snap.count) snap.count++;
+   __atomic_add_fetch(&snap.seq, 1, __ATOMIC_RELEASE);
+}
+
+/* ------------------------------------------------------------ *
+ * snap_copy() - consistent copy of the snapshot samples        *
+ * ------------------------------------------------------------ */
+static int snap_copy(struct bnosample smp[]) {
+   uint32_t s1, s2;
+   int count;
+   do {
+      while((s1 = __atomic_load_n(&snap.seq, __ATOMIC_ACQUIRE)) & 1) sched_yield();
+      count = snap.count;
+      memcpy(smp, snap.smp, sizeof(struct bnosample) * count);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      s2 = __atomic_load_n(&snap.seq, __ATOMIC_RELAXED);
+   } while(s1 != s2);
+   return(count);
+}
+
+/* ------------------------------------------------------------ *
+ * snap_label() - report name and axis labels for the HTML table*
+ * ------------------------------------------------------------ */
+static const char *snap_label(uint8_t repid, const char **axis) {
+   static const char *xyz = "XYZ", *ijkr = "IJKR";
+   *axis = xyz;
+   switch(repid) {
+      case SENSOR_REPORTID_ACC: return("Accelerometer");
+      case SENSOR_REPORTID_GYR: return("Gyroscope");
+      case SENSOR_REPORTID_MAG: return("Magnetometer");
+      case SENSOR_REPORTID_LIN: return("Linear Acceleration");
+      case SENSOR_REPORTID_ROT: *axis = ijkr; return("Rotation Vector");
+      case SENSOR_REPORTID_GAM: *axis = ijkr; return("Game Rotation Vector");
+      case SENSOR_REPORTID_GIR: *axis = ijkr; return("Gyro-Integrated Rotation Vector");
+   }
+   return("Sensor");
+}
+
+/* ------------------------------------------------------------ *
+ * snap_cat() - append to the render buffer p at n. Returns the *
+ * new length, a truncated text stops at the end of the buffer. *
+ * ------------------------------------------------------------ */
+static int snap_cat(char *p, int n, const char *fmt, ...) {
+   va_list ap;
+   if(n >= SNAP_BUFSIZE - 1) return(SNAP_BUFSIZE - 1);
+   va_start(ap, fmt);
+   int res = vsnprintf(p+n, SNAP_BUFSIZE-n, fmt, ap);
+   va_end(ap);
+   if(res < 0) return(n);
+   return((n + res < SNAP_BUFSIZE) ? n + res : SNAP_BUFSIZE - 1);
+}
+
+/* ------------------------------------------------------------ *
+ * snap_html() - render the table format used by the -o option  *
+ * ------------------------------------------------------------ */
+static int snap_html(char *p, struct bnosample smp[], int count) {
+   const char *axis;
+   float val[4];
+   int n = snap_cat(p, 0, "<table>\n");
+   for(int i = 0; i < count; i++) {
+      const char *name = snap_label(smp[i].repid, &axis);
+      int vals = sample_float(&smp[i], val);
+      n = snap_cat(p, n, "<tr>\n");
+      for(int j = 0; j < vals; j++) {
+         if(j > 0) n = snap_cat(p, n, "<td class=\"sensorspace\"></td>\n");
+         n = snap_cat(p, n, "<td class=\"sensordata\">%s %c:<span class=\"sensorvalue\">%3.2f</span></td>\n",
+                      name, axis[j], val[j]);
+      }
+      n = snap_cat(p, n, "</tr>\n");
+   }
+   return(snap_cat(p, n, "</table>\n"));
+}
+
+/* ------------------------------------------------------------ *
+ * snap_json() - render the records as one JSON document        *
+ * ------------------------------------------------------------ */
+static int snap_json(char *p, struct bnosample smp[], int count) {
+   float val[4];
+   int n = snap_cat(p, 0, "{\"ts\":%u,\"reports\":[", sink_clock());
+   for(int i = 0; i < count; i++) {
+      int vals = sample_float(&smp[i], val);
+      n = snap_cat(p, n, "%s{\"report\":%d,\"ts\":%u,\"status\":%d,\"v\":[",
+                   (i > 0) ? "," : "", smp[i].repid, smp[i].ts, smp[i].acc);
+      for(int j = 0; j < vals; j++)
+         n = snap_cat(p, n, "%s%f", (j > 0) ? "," : "", val[j]);
+      n = snap_cat(p, n, "]}");
+   }
+   return(snap_cat(p, n, "]}\n"));
+}
+
+/* ------------------------------------------------------------ *
+ * publish_file() - write data to "file.tmp" and rename it over *
+ * file. rename() is atomic, readers see old or new content.    *
+ * ------------------------------------------------------------ */
+int publish_file(char *file, char *data, int len) {
+   char tmp[SNAP_PATHLEN];
+   if(snprintf(tmp, sizeof(tmp), "%s.tmp", file) >= (int) sizeof(tmp)) return(-1);
+
+   int fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+   if(fd < 0) {
+      printf("Error open %s for writing.\n", tmp);
+      return(-1);
+   }
+   int done = 0;
+   while(done < len) {
+      ssize_t w = write(fd, data + done, len - done);
+      if(w < 0 && errno == EINTR) continue;
+      if(w < 0) break;
+      done += w;
+   }
+   close(fd);
+   if(done != len || rename(tmp, file) != 0) {
+      printf("Error: cannot publish %s: %s\n", file, strerror(errno));
+      unlink(tmp);
+      return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * snap_publish() - render into the idle buffer and publish it  *
+ * if the content changed since the last write.                 *
+ * ------------------------------------------------------------ */
+static void snap_publish(struct snapfile *sf, struct bnosample smp[], int count,
+                         int (*render)(char*, struct bnosample*, int)) {
+   if(sf->file == NULL) return;
+   int idle = sf->cur ^ 1;
+   sf->len[idle] = render(sf->buf[idle], smp, count);
+   if(sf->len[idle] == sf->len[sf->cur]
+      && memcmp(sf->buf[idle], sf->buf[sf->cur], sf->len[idle]) == 0) return;
+   if(publish_file(sf->file, sf->buf[idle], sf->len[idle]) == 0) sf->cur = idle;
+}
+
+/* ------------------------------------------------------------ *
+ * snap_writer() - the writer thread, renders every snap_period *
+ * ------------------------------------------------------------ */
+static void *snap_writer(void *arg) {
+   struct bnosample smp[SNAP_SLOTS];
+   struct timespec next;
+   clock_gettime(CLOCK_MONOTONIC, &next);
+
+   while(snap_run) {
+      next.tv_nsec += (long) snap_period * 1000000L;
+      while(next.tv_nsec >= 1000000000L) {
+         next.tv_nsec -= 1000000000L;
+         next.tv_sec++;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+      int count = snap_copy(smp);
+      if(count == 0) continue;
+      snap_publish(&snap_htm, smp, count, snap_html);
+      snap_publish(&snap_jsn, smp, count, snap_json);
+   }
+   return(NULL);
+}
+
+/* ------------------------------------------------------------ *
+ * snap_start() - start the writer thread for the HTML and/or   *
+ * JSON file (NULL or empty disables one), every period ms.     *
+ * ------------------------------------------------------------ */
+int snap_start(char *htmfile, char *jsnfile, int period) {
+   snap_htm.file = (htmfile && htmfile[0]) ? htmfile : NULL;
+   snap_jsn.file = (jsnfile && jsnfile[0]) ? jsnfile : NULL;
+   snap_htm.len[0] = snap_htm.len[1] = -1;
+   snap_jsn.len[0] = snap_jsn.len[1] = -1;
+   snap_period = period;
+   snap_run = 1;
+
+   if(pthread_create(&snap_thread, NULL, snap_writer, NULL) != 0) {
+      printf("Error: cannot start snapshot writer thread.\n");
+      return(-1);
+   }
+   if(verbose == 1) printf("Debug: Snapshot writer every %d ms\n", period);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * snap_stop() - stop the writer thread after its last update   *
+ * ------------------------------------------------------------ */
+void snap_stop() {
+   if(snap_run == 0) return;
+   snap_run = 0;
+   pthread_join(snap_thread, NULL);
+}
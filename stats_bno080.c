@@ -0,0 +1,364 @@
+/* ------------------------------------------------------------ *
+ * file:        stats_bno080.c                                  *
+ * purpose:     Always-on transaction instrumentation. Keeps    *
+ *              log-linear latency histograms per operation and *
+ *              per SHTP channel, plus packet and byte counters.*
+ *              Updates are a few relaxed atomic adds, so they  *
+ *              stay enabled in production. Summary output via  *
+ *              --stats or SIGUSR1, JSON dump via --stats-file. *
+ *              Counters are per thread, stats_merge() joins.   *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include "getbno080.h"
+
+// Sequence errors within SEQ_WINDOW packets that trigger a resync
+#define SEQ_WINDOW       256
+#define SEQ_RESYNC_LIMIT 8
+
+__thread struct bnostats stats;
+volatile sig_atomic_t stats_signal = 0;
+
+static const char *op_name[OP_COUNT] = {
+   "send", "receive", "calstat", "prodid", "frs", "reset", "errlist", "feature",
+   "wake"
+};
+static __thread const char *stats_bus = "";
+static __thread const char *stats_addr = "";
+
+/* ------------------------------------------------------------ *
+ * stats_now() - monotonic clock in nanoseconds                 *
+ * ------------------------------------------------------------ */
+uint64_t stats_now() {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/* ------------------------------------------------------------ *
+ * hist_bucket() - log-linear bucket index for a value in usecs *
+ * Values below 16 get their own bucket, above that each power  *
+ * of two is split into 8 linear steps (max 12.5% error).       *
+ * ------------------------------------------------------------ */
+static int hist_bucket(uint64_t v) {
+   if(v < 16) return(v);
+   int e = 63 - __builtin_clzll(v);            // index of the msb
+   if(e > 31) return(HIST_BUCKETS - 1);
+   return(16 + (e - 4) * 8 + ((v >> (e - 3)) & 7));
+}
+
+/* ------------------------------------------------------------ *
+ * hist_value() - lower bound of the values in bucket b         *
+ * ------------------------------------------------------------ */
+static uint64_t hist_value(int b) {
+   if(b < 16) return(b);
+   int e = (b - 16) / 8 + 4;
+   return(((uint64_t) 8 + (b - 16) % 8) << (e - 3));
+}
+
+/* ------------------------------------------------------------ *
+ * hist_add() - add one latency sample in microseconds. The     *
+ * first sample sets min, 0 usecs is a valid minimum.           *
+ * ------------------------------------------------------------ */
+void hist_add(struct hist *h, uint64_t us) {
+   __atomic_add_fetch(&h->bucket[hist_bucket(us)], 1, __ATOMIC_RELAXED);
+   uint64_t count = __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&h->sum, us, __ATOMIC_RELAXED);
+   if(us > h->max) __atomic_store_n(&h->max, us, __ATOMIC_RELAXED);
+   if(count == 1 || us < h->min) __atomic_store_n(&h->min, us, __ATOMIC_RELAXED);
+}
+
+/* ------------------------------------------------------------ *
+ * hist_pct() - value at the given percentile (0.0 - 100.0)     *
+ * ------------------------------------------------------------ */
+uint64_t hist_pct(struct hist *h, double pct) {
+   if(h->count == 0) return(0);
+   uint64_t rank = (uint64_t) (h->count * pct / 100.0);
+   uint64_t seen = 0;
+   for(int b = 0; b < HIST_BUCKETS; b++) {
+      seen += h->bucket[b];
+      if(seen > rank) {
+         // report the bucket middle, not its lower bound
+         uint64_t v = (hist_value(b) + hist_value(b + 1)) / 2;
+         if(b < 16) v = b;
+         return(v > h->max ? h->max : v);
+      }
+   }
+   return(h->max);
+}
+
+/* ------------------------------------------------------------ *
+ * hist_merge() - add all samples of histogram from into to     *
+ * ------------------------------------------------------------ */
+static void hist_merge(struct hist *to, const struct hist *from) {
+   if(from->count == 0) return;
+   if(to->count == 0 || from->min < to->min) to->min = from->min;
+   if(from->max > to->max) to->max = from->max;
+   to->count += from->count;
+   to->sum += from->sum;
+   for(int b = 0; b < HIST_BUCKETS; b++) to->bucket[b] += from->bucket[b];
+}
+
+/* ------------------------------------------------------------ *
+ * stats_merge() - add the counters of the calling thread into  *
+ * to, the stats of the thread that prints them. Bus threads    *
+ * call it before they end, their thread-local copy is lost at  *
+ * thread exit. Serialized, several threads may end at once.    *
+ * ------------------------------------------------------------ */
+void stats_merge(struct bnostats *to) {
+   static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+   if(to == NULL || to == &stats) return;
+   pthread_mutex_lock(&lock);
+   for(int i = 0; i < ERR_COUNT; i++) to->errors[i] += stats.errors[i];
+   for(int i = 0; i < RECOV_COUNT; i++) to->recov[i] += stats.recov[i];
+   hist_merge(&to->recovtime, &stats.recovtime);
+   to->resyncs += stats.resyncs;
+   for(int i = 0; i < OP_COUNT; i++) hist_merge(&to->op[i], &stats.op[i]);
+   for(int c = 0; c < SHTP_CHANNELS; c++) {
+      struct chanstats *t = &to->chan[c], *f = &stats.chan[c];
+      for(int d = 0; d < 2; d++) {
+         t->packets[d] += f->packets[d];
+         t->bytes[d] += f->bytes[d];
+         hist_merge(&t->lat[d], &f->lat[d]);
+      }
+      t->gaps += f->gaps;
+      t->lost += f->lost;
+      t->dups += f->dups;
+      t->reorders += f->reorders;
+   }
+   pthread_mutex_unlock(&lock);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_op() - record an operation that started at start (ns)  *
+ * ------------------------------------------------------------ */
+void stats_op(statop_t op, uint64_t start) {
+   hist_add(&stats.op[op], (stats_now() - start) / 1000);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_chan() - count one packet sent (dir 0) or received     *
+ * (dir 1) on a channel, and record its bus transfer time.      *
+ * ------------------------------------------------------------ */
+void stats_chan(int dir, int chan, int bytes, uint64_t start) {
+   if(chan < 0 || chan >= SHTP_CHANNELS) return;
+   struct chanstats *cs = &stats.chan[chan];
+   __atomic_add_fetch(&cs->packets[dir], 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&cs->bytes[dir], bytes, __ATOMIC_RELAXED);
+   hist_add(&cs->lat[dir], (stats_now() - start) / 1000);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_seq() - check the sequence number of a packet received *
+ * on chan against the last one. The 8-bit number wraps, so a   *
+ * forward distance up to 127 is a gap and a larger one means   *
+ * an older, reordered packet. SEQ_RESYNC_LIMIT errors within   *
+ * SEQ_WINDOW packets flag the stream for a resync.             *
+ * ------------------------------------------------------------ */
+seqres_t stats_seq(int chan, uint8_t seq) {
+   if(chan < 0 || chan >= SHTP_CHANNELS) return(SEQ_OK);
+   struct chanstats *cs = &stats.chan[chan];
+   seqres_t res = SEQ_OK;
+
+   if(cs->seqvalid == 0) {
+      cs->seqvalid = 1;
+      cs->rxseq = seq;
+      return(SEQ_OK);
+   }
+
+   uint8_t diff = seq - cs->rxseq;
+   if(diff == 0) {
+      res = SEQ_DUP;
+      cs->dups++;
+   }
+   else if(diff >= 128) {
+      res = SEQ_REORDER;
+      cs->reorders++;
+   }
+   else if(diff > 1) {
+      res = SEQ_GAP;
+      cs->gaps++;
+      cs->lost += diff - 1;
+   }
+   if(res != SEQ_REORDER) cs->rxseq = seq; // keep the newest
+
+   if(res != SEQ_OK) {
+      cs->winbad++;
+      if(verbose == 1) printf("Debug: chan %d seq [%02X] expected [%02X], %s\n",
+                               chan, seq, (uint8_t) (cs->rxseq + 1),
+                               (res == SEQ_GAP) ? "gap" : (res == SEQ_DUP) ? "dup" : "reorder");
+   }
+   if(cs->winbad >= SEQ_RESYNC_LIMIT) stats.resync = 1;
+   if(++cs->winpkts >= SEQ_WINDOW) {
+      cs->winpkts = 0;
+      cs->winbad = 0;
+   }
+   return(res);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_seq_reset() - forget the received sequence numbers,    *
+ * after a sensor reset or resync the next packet is the base.  *
+ * ------------------------------------------------------------ */
+void stats_seq_reset() {
+   for(int c = 0; c < SHTP_CHANNELS; c++) {
+      stats.chan[c].seqvalid = 0;
+      stats.chan[c].winpkts = 0;
+      stats.chan[c].winbad = 0;
+   }
+   stats.resync = 0;
+}
+
+/* ------------------------------------------------------------ *
+ * stats_sigusr1() - request a summary from the main loop. The  *
+ * printing itself is not async-signal-safe, see stats_poll().  *
+ * ------------------------------------------------------------ */
+static void stats_sigusr1(int sig) {
+   stats_signal = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * stats_init() - remember the bus for the dump, set up SIGUSR1 *
+ * ------------------------------------------------------------ */
+void stats_init(char *bus, char *addr) {
+   struct sigaction sa;
+   stats_bus = bus;
+   stats_addr = addr;
+   stats.start = stats_now();
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = stats_sigusr1;
+   sa.sa_flags = SA_RESTART;
+   sigaction(SIGUSR1, &sa, NULL);
+}
+
+/* ------------------------------------------------------------ *
+ * print_hist() - one summary line for a histogram              *
+ * ------------------------------------------------------------ */
+static void print_hist(FILE *fp, const char *name, struct hist *h) {
+   if(h->count == 0) return;
+   fprintf(fp, "%-14s %8llu %7llu %7llu %7llu %7llu %7llu %7llu\n", name,
+           (unsigned long long) h->count, (unsigned long long) h->min,
+           (unsigned long long) (h->sum / h->count),
+           (unsigned long long) hist_pct(h, 50.0),
+           (unsigned long long) hist_pct(h, 99.0),
+           (unsigned long long) hist_pct(h, 99.9),
+           (unsigned long long) h->max);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_print() - human readable summary of all counters       *
+ * ------------------------------------------------------------ */
+void stats_print(FILE *fp) {
+   char name[16];
+   double secs = (stats_now() - stats.start) / 1e9;
+
+   fprintf(fp, "\nBNO080 Statistics for %s addr %s, %.1f seconds\n",
+           stats_bus, stats_addr, secs);
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Operation         count     min     avg     p50     p99    p999     max (usec)\n");
+   for(int i = 0; i < OP_COUNT; i++) print_hist(fp, op_name[i], &stats.op[i]);
+   for(int c = 0; c < SHTP_CHANNELS; c++) {
+      snprintf(name, sizeof(name), "tx chan %d", c);
+      print_hist(fp, name, &stats.chan[c].lat[0]);
+      snprintf(name, sizeof(name), "rx chan %d", c);
+      print_hist(fp, name, &stats.chan[c].lat[1]);
+   }
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Channel  TX packets    TX bytes  RX packets    RX bytes    gaps    lost    dups reorder\n");
+   for(int c = 0; c < SHTP_CHANNELS; c++) {
+      struct chanstats *cs = &stats.chan[c];
+      if(cs->packets[0] == 0 && cs->packets[1] == 0) continue;
+      fprintf(fp, "%7d %11llu %11llu %11llu %11llu %7llu %7llu %7llu %7llu\n", c,
+              (unsigned long long) cs->packets[0], (unsigned long long) cs->bytes[0],
+              (unsigned long long) cs->packets[1], (unsigned long long) cs->bytes[1],
+              (unsigned long long) cs->gaps, (unsigned long long) cs->lost,
+              (unsigned long long) cs->dups, (unsigned long long) cs->reorders);
+   }
+   fprintf(fp, "Sequence resyncs: %llu\n", (unsigned long long) stats.resyncs);
+   print_recov(fp);
+   print_hist(fp, "recovery time", &stats.recovtime);
+}
+
+/* ------------------------------------------------------------ *
+ * json_hist() - append one histogram as JSON object, only the  *
+ * non-empty buckets are listed as [lower bound usec, count].   *
+ * ------------------------------------------------------------ */
+static int json_hist(char *p, int size, struct hist *h) {
+   int n = snprintf(p, size, "{\"count\":%llu,\"sum\":%llu,\"min\":%llu,\"max\":%llu,\"buckets\":[",
+                    (unsigned long long) h->count, (unsigned long long) h->sum,
+                    (unsigned long long) h->min, (unsigned long long) h->max);
+   int first = 1;
+   for(int b = 0; b < HIST_BUCKETS && n < size; b++) {
+      if(h->bucket[b] == 0) continue;
+      n += snprintf(p+n, size-n, "%s[%llu,%u]", first ? "" : ",",
+                    (unsigned long long) hist_value(b), h->bucket[b]);
+      first = 0;
+   }
+   if(n < size) n += snprintf(p+n, size-n, "]}");
+   return(n);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_json() - render all counters as one JSON document.     *
+ * Returns the length, or -1 if buf was too small.              *
+ * ------------------------------------------------------------ */
+int stats_json(char *buf, int size) {
+   int n = snprintf(buf, size, "{\"bus\":\"%s\",\"addr\":\"%s\",\"uptime_ns\":%llu,\"ops\":{",
+                    stats_bus, stats_addr, (unsigned long long) (stats_now() - stats.start));
+   for(int i = 0; i < OP_COUNT && n < size; i++) {
+      n += snprintf(buf+n, size-n, "%s\"%s\":", i ? "," : "", op_name[i]);
+      if(n < size) n += json_hist(buf+n, size-n, &stats.op[i]);
+   }
+   if(n < size) n += snprintf(buf+n, size-n, "},\"channels\":[");
+   for(int c = 0; c < SHTP_CHANNELS && n < size; c++) {
+      struct chanstats *cs = &stats.chan[c];
+      n += snprintf(buf+n, size-n, "%s{\"chan\":%d,\"tx_packets\":%llu,\"tx_bytes\":%llu,"
+                    "\"rx_packets\":%llu,\"rx_bytes\":%llu,\"seq_gaps\":%llu,\"seq_lost\":%llu,"
+                    "\"seq_dups\":%llu,\"seq_reorders\":%llu,\"tx_lat\":", c ? "," : "", c,
+                    (unsigned long long) cs->packets[0], (unsigned long long) cs->bytes[0],
+                    (unsigned long long) cs->packets[1], (unsigned long long) cs->bytes[1],
+                    (unsigned long long) cs->gaps, (unsigned long long) cs->lost,
+                    (unsigned long long) cs->dups, (unsigned long long) cs->reorders);
+      if(n < size) n += json_hist(buf+n, size-n, &cs->lat[0]);
+      if(n < size) n += snprintf(buf+n, size-n, ",\"rx_lat\":");
+      if(n < size) n += json_hist(buf+n, size-n, &cs->lat[1]);
+      if(n < size) n += snprintf(buf+n, size-n, "}");
+   }
+   if(n < size) n += snprintf(buf+n, size-n, "],\"resyncs\":%llu,",
+                              (unsigned long long) stats.resyncs);
+   if(n < size) n += json_recov(buf+n, size-n);
+   if(n < size) n += snprintf(buf+n, size-n, ",\"recovery_time\":");
+   if(n < size) n += json_hist(buf+n, size-n, &stats.recovtime);
+   if(n < size) n += snprintf(buf+n, size-n, "}\n");
+   return(n < size ? n : -1);
+}
+
+/* ------------------------------------------------------------ *
+ * stats_dump() - write the JSON document atomically to file    *
+ * ------------------------------------------------------------ */
+int stats_dump(char *file) {
+   static char buf[STATS_JSONSIZE];
+   int len = stats_json(buf, sizeof(buf));
+   if(len < 0) {
+      printf("Error: statistics dump exceeds %d bytes.\n", STATS_JSONSIZE);
+      return(-1);
+   }
+   return(publish_file(file, buf, len));
+}
+
+/* ------------------------------------------------------------ *
+ * stats_poll() - called from the main loop, outputs the summary*
+ * and dump after a SIGUSR1 was received.                       *
+ * ------------------------------------------------------------ */
+void stats_poll(char *file) {
+   if(stats_signal == 0) return;
+   stats_signal = 0;
+   stats_print(stderr);
+   if(file != NULL && file[0] != '\0') stats_dump(file);
+}
@@ -0,0 +1,193 @@
+/* ------------------------------------------------------------ *
+ * file:        sync_bno080.c                                   *
+ * purpose:     Frame assembler for --sync in multi-bus mode.   *
+ *              Each sensor reports on its own clock and phase, *
+ *              the assembler resamples all device streams to   *
+ *              one output tick: linear interpolation for the   *
+ *              vectors, SLERP for the rotation vectors. Ticks  *
+ *              are built in batches, each frame holds the same *
+ *              instant of all devices. A device that falls     *
+ *              behind holds the frames for SYNC_HOLD_US at     *
+ *              most, then it is left out of the frame mask.    *
+ *              Enabled with --sync hz, see emit_frame().       *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "getbno080.h"
+
+// Samples kept per device, a power of 2
+#define SYNC_DEPTH   64
+// Frames computed per batch
+#define SYNC_BATCH   32
+// Max time a frame waits for a late device, in usecs
+#define SYNC_HOLD_US 50000
+
+struct syncdev{
+   uint32_t ts[SYNC_DEPTH];              // sample times, usecs
+   float    v[SYNC_DEPTH][4];            // sample values
+   uint32_t head;                        // samples pushed
+   uint32_t pos;                         // oldest sample still needed
+};
+
+static struct syncdev sdev[MULTI_MAX];
+static int sync_ndev = 0;
+static uint32_t sync_us;                 // tick period
+static uint32_t tick;                    // next output tick
+static int sync_run = 0;                 // 1 = first tick is set
+static uint32_t sync_first;              // time of the first sample
+static uint8_t sync_repid, sync_q;
+static void (*sync_out)(struct bnoframe*, void*);
+static void *sync_arg;
+
+/* ------------------------------------------------------------ *
+ * sync_start() - resample ndev streams to hz frames per second *
+ * and pass each frame to out(frm, arg). Returns 0 or -1.       *
+ * ------------------------------------------------------------ */
+int sync_start(int ndev, float hz, void (*out)(struct bnoframe*, void*), void *arg) {
+   if(ndev < 1 || ndev > MULTI_MAX || hz <= 0) {
+      printf("Error: --sync needs 1..%d devices and a rate above 0.\n", MULTI_MAX);
+      return(-1);
+   }
+   memset(sdev, 0, sizeof(sdev));
+   sync_ndev = ndev;
+   sync_us = (uint32_t) (1000000.0f / hz);
+   sync_run = 0;
+   sync_first = 0;
+   sync_out = out;
+   sync_arg = arg;
+   if(verbose == 1) printf("Debug: Sync %d devices at %u usec ticks\n", ndev, sync_us);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * slerp() - spherical interpolation from a to b by w, takes    *
+ * the short way. Nearly equal quaternions use normalized lerp. *
+ * ------------------------------------------------------------ */
+static void slerp(const float *a, const float *b, float w, float *out) {
+   float d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3];
+   float s = (d < 0) ? -1.0f : 1.0f;
+   float wa = 1.0f - w, wb = w * s;
+   d *= s;
+   if(d < 0.9995f) {
+      float th = acosf(d);
+      float si = 1.0f / sinf(th);
+      wa = sinf(wa * th) * si;
+      wb = sinf(w * th) * si * s;
+   }
+   float n = 0;
+   for(int i = 0; i < 4; i++) {
+      out[i] = wa * a[i] + wb * b[i];
+      n += out[i] * out[i];
+   }
+   n = (n > 0) ? 1.0f / sqrtf(n) : 0;
+   for(int i = 0; i < 4; i++) out[i] *= n;
+}
+
+/* ------------------------------------------------------------ *
+ * sync_batch() - build nt frames from tick on. For each device *
+ * the bracketing samples and weights are found first, then the *
+ * values are interpolated in one pass over the batch.          *
+ * ------------------------------------------------------------ */
+static void sync_batch(int nt) {
+   static struct bnoframe frm[SYNC_BATCH];
+   uint16_t ia[SYNC_BATCH], ib[SYNC_BATCH];
+   float w[SYNC_BATCH];
+   float scale = ldexpf(1.0f, sync_q);
+   int quat = REPORT_QUAT(sync_repid);
+
+   for(int k = 0; k < nt; k++) {
+      frm[k].ts = tick + k * sync_us;
+      frm[k].repid = sync_repid;
+      frm[k].q = sync_q;
+      frm[k].ndev = sync_ndev;
+      frm[k].mask = 0;
+      memset(frm[k].v, 0, sizeof(frm[k].v));
+   }
+
+   for(int d = 0; d < sync_ndev; d++) {
+      struct syncdev *s = &sdev[d];
+      if(s->head == 0) continue;         // no sample from this device yet
+      for(int k = 0; k < nt; k++) {
+         uint32_t t = frm[k].ts;
+         while(s->pos + 1 < s->head
+               && (int32_t) (s->ts[(s->pos + 1) & (SYNC_DEPTH - 1)] - t) <= 0) s->pos++;
+         uint32_t a = s->pos & (SYNC_DEPTH - 1);
+         int32_t da = (int32_t) (t - s->ts[a]);
+         ia[k] = ib[k] = a;
+         w[k] = 0;
+         if(s->pos + 1 < s->head) {
+            uint32_t b = (s->pos + 1) & (SYNC_DEPTH - 1);
+            int32_t span = (int32_t) (s->ts[b] - s->ts[a]);
+            ib[k] = b;
+            if(da > 0 && span > 0) w[k] = (float) da / span;
+         }
+         // only hold the last sample for a device up to SYNC_HOLD_US
+         else if(da > SYNC_HOLD_US) continue;
+         frm[k].mask |= 1 << d;
+      }
+      for(int k = 0; k < nt; k++) {
+         if((frm[k].mask & (1 << d)) == 0) continue;
+         float v[4];
+         const float *a = s->v[ia[k]], *b = s->v[ib[k]];
+         if(quat) slerp(a, b, w[k], v);
+         else for(int i = 0; i < 4; i++) v[i] = a[i] + w[k] * (b[i] - a[i]);
+         for(int i = 0; i < 4; i++) {
+            float x = roundf(v[i] * scale);
+            frm[k].v[d][i] = (x > 32767) ? 32767 : (x < -32768) ? -32768 : x;
+         }
+      }
+   }
+   for(int k = 0; k < nt; k++) sync_out(&frm[k], sync_arg);
+   tick += nt * sync_us;
+}
+
+/* ------------------------------------------------------------ *
+ * sync_sample() - take one sample of the time-ordered stream.  *
+ * Frames are built up to the oldest of the devices' newest     *
+ * samples, so each tick has samples on both sides, but at most *
+ * SYNC_HOLD_US behind the stream.                              *
+ * ------------------------------------------------------------ */
+void sync_sample(struct bnosample *smp, void *arg) {
+   if(smp->dev >= sync_ndev) return;
+   struct syncdev *s = &sdev[smp->dev];
+   float scale = ldexpf(1.0f, -smp->q);
+   uint32_t i = s->head & (SYNC_DEPTH - 1);
+
+   if(sync_run == 0 && sync_first == 0) sync_first = smp->ts;
+   if(s->head - s->pos == SYNC_DEPTH) s->pos++;  // drop the oldest
+   s->ts[i] = smp->ts;
+   for(int a = 0; a < 4; a++) s->v[i][a] = smp->v[a] * scale;
+   s->head++;
+   sync_repid = smp->repid;
+   sync_q = smp->q;
+
+   /* --------------------------------------------------------- *
+    * Horizon: the oldest of the devices' newest samples, or    *
+    * the stream time less SYNC_HOLD_US if a device is late     *
+    * --------------------------------------------------------- */
+   uint32_t horizon = smp->ts;
+   int all = 1;
+   for(int d = 0; d < sync_ndev; d++) {
+      if(sdev[d].head == 0) {
+         all = 0;
+         continue;
+      }
+      uint32_t last = sdev[d].ts[(sdev[d].head - 1) & (SYNC_DEPTH - 1)];
+      if((int32_t) (last - horizon) < 0) horizon = last;
+   }
+   if((int32_t) (smp->ts - SYNC_HOLD_US - horizon) > 0) horizon = smp->ts - SYNC_HOLD_US;
+
+   if(sync_run == 0) {
+      if(all == 0 && (int32_t) (smp->ts - sync_first) < SYNC_HOLD_US) return;
+      tick = horizon;                    // first tick has all devices
+      sync_run = 1;
+   }
+   while((int32_t) (horizon - tick) >= 0) {
+      int nt = (int32_t) (horizon - tick) / sync_us + 1;
+      sync_batch((nt > SYNC_BATCH) ? SYNC_BATCH : nt);
+   }
+}
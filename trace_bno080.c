@@ -0,0 +1,122 @@
+/* ------------------------------------------------------------ *
+ * file:        trace_bno080.c                                  *
+ * purpose:     In-memory binary event trace of the SHTP packet *
+ *              traffic. sendPacket() and receivePacket() store *
+ *              a fixed-size event into a lock-free ring, which *
+ *              costs a few stores instead of a printf per byte.*
+ *              The ring is decoded to text only on demand: at  *
+ *              exit with -v, or on SIGUSR2.                    *
+ *              Holds the last TRACE_SIZE events per thread.    *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "getbno080.h"
+
+// Ring size in events, must be a power of two
+#define TRACE_SIZE 4096
+#define TRACE_MASK (TRACE_SIZE - 1)
+
+static __thread struct trace_ev ring[TRACE_SIZE];
+static __thread uint32_t ring_head;                // next event number
+static uint64_t trace_start;              // trace_init() time in nsecs
+volatile sig_atomic_t trace_signal = 0;
+
+/* ------------------------------------------------------------ *
+ * trace_event() - record one event. head points to the 4-byte  *
+ * SHTP header, cargo to the first cargo bytes (may be NULL).   *
+ * Producers claim a slot with one atomic add, no locking.      *
+ * ------------------------------------------------------------ */
+void trace_event(uint8_t type, uint8_t err, uint16_t len,
+                 uint8_t *head, uint8_t *cargo, int cargolen) {
+   uint32_t n = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+   struct trace_ev *ev = &ring[n & TRACE_MASK];
+
+   ev->ts = stats_now();
+   ev->type = type;
+   ev->err = err;
+   ev->len = len;
+   if(head != NULL) memcpy(ev->head, head, 4);
+   else memset(ev->head, 0, 4);
+   if(cargolen > TRACE_CARGO) cargolen = TRACE_CARGO;
+   if(cargo != NULL && cargolen > 0) memcpy(ev->cargo, cargo, cargolen);
+   ev->cargolen = (cargo != NULL && cargolen > 0) ? cargolen : 0;
+}
+
+/* ------------------------------------------------------------ *
+ * trace_sigusr2() - request a trace dump from the main loop    *
+ * ------------------------------------------------------------ */
+static void trace_sigusr2(int sig) {
+   trace_signal = 1;
+}
+
+/* ------------------------------------------------------------ *
+ * trace_init() - set the time base and the SIGUSR2 handler     *
+ * ------------------------------------------------------------ */
+void trace_init() {
+   struct sigaction sa;
+   trace_start = stats_now();
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = trace_sigusr2;
+   sa.sa_flags = SA_RESTART;
+   sigaction(SIGUSR2, &sa, NULL);
+}
+
+/* ------------------------------------------------------------ *
+ * trace_print() - decode one event into the old debug format   *
+ * ------------------------------------------------------------ */
+static void trace_print(FILE *fp, struct trace_ev *ev) {
+   static const char *type_str[] = { "TX", "RX", "--", "ER" };
+   uint64_t us = (ev->ts - trace_start) / 1000;
+
+   fprintf(fp, "Debug: %6llu.%03llu %s", (unsigned long long) us / 1000,
+           (unsigned long long) us % 1000, type_str[ev->type & 3]);
+
+   switch(ev->type) {
+      case TRACE_NODATA:
+         fprintf(fp, " No SHTP data available\n");
+         return;
+      case TRACE_ERR:
+         fprintf(fp, " I2C failure after %d bytes: %s, HEAD %02X %02X %02X %02X\n",
+                 ev->len, strerror(ev->err),
+                 ev->head[0], ev->head[1], ev->head[2], ev->head[3]);
+         return;
+   }
+
+   fprintf(fp, " %3d bytes HEAD %02X %02X %02X %02X CARGO", ev->len,
+           ev->head[0], ev->head[1], ev->head[2], ev->head[3]);
+   for(int i = 0; i < ev->cargolen; i++) fprintf(fp, " %02X", ev->cargo[i]);
+   if(ev->len - 4 > ev->cargolen) fprintf(fp, " +%d more bytes", ev->len - 4 - ev->cargolen);
+   if(ev->type == TRACE_RX) fprintf(fp, " ST [%d]", ev->err);
+   fprintf(fp, "\n");
+
+   if(ev->type == TRACE_RX && ev->cargo[0] == COMMAND_RESPONSE && ev->cargolen >= 6) {
+      fprintf(fp, "Debug: CMD reportID [%02X] REPseq [%02X] CMD [%02X] CMDseq [%02X] RESPseq [%02X] R0 [%02X]\n",
+              ev->cargo[0], ev->cargo[1], ev->cargo[2], ev->cargo[3], ev->cargo[4], ev->cargo[5]);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * trace_dump() - decode the ring, oldest event first           *
+ * ------------------------------------------------------------ */
+void trace_dump(FILE *fp) {
+   uint32_t end = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+   uint32_t n = (end > TRACE_SIZE) ? end - TRACE_SIZE : 0;
+
+   fprintf(fp, "Debug: SHTP trace, %u events, %u shown\n", end, end - n);
+   for(; n != end; n++) trace_print(fp, &ring[n & TRACE_MASK]);
+   fflush(fp);
+}
+
+/* ------------------------------------------------------------ *
+ * trace_poll() - called from the main loop, dumps the trace    *
+ * to stderr after a SIGUSR2 was received.                      *
+ * ------------------------------------------------------------ */
+void trace_poll() {
+   if(trace_signal == 0) return;
+   trace_signal = 0;
+   trace_dump(stderr);
+}
@@ -0,0 +1,266 @@
+/* ------------------------------------------------------------ *
+ * file:        watch_bno080.c                                  *
+ * purpose:     Stall watchdog and report rate monitor for      *
+ *              --watchdog. The reader records the arrival of   *
+ *              each input report, a watchdog thread checks all *
+ *              enabled reports every WD_TICK_MS. A report that *
+ *              is silent past its deadline, or runs below the  *
+ *              set fraction of its rate, raises an alarm: it   *
+ *              is counted for --stats and --metrics, and the   *
+ *              reader is interrupted and runs the recovery,    *
+ *              the checks pause until it is done.              *
+ *              Enabled with --watchdog, held by wd_hold().     *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include "getbno080.h"
+
+// Watchdog check period in millisecs
+#define WD_TICK_MS    50
+// Rate measuring window in millisecs, at least WD_MIN_SAMPLES long
+#define WD_WINDOW_MS  250
+// Expected samples a rate window and a stall deadline span at least
+#define WD_MIN_SAMPLES 4
+
+typedef enum {
+   WD_STALL = 0x00,     // no report past the deadline
+   WD_SLOW  = 0x01,     // rate below the set fraction
+   WD_COUNT
+} wdalarm_t;
+
+/* ------------------------------------------------------------ *
+ * Per report ID: expect and the arrivals are written by the    *
+ * reader, the window fields belong to the watchdog thread.     *
+ * ------------------------------------------------------------ */
+struct wdrep{
+   uint32_t expect;                      // set interval in usecs, 0 = off
+   uint64_t last;                        // last arrival, stats_now() nsecs
+   uint64_t count;                       // arrivals
+   uint64_t win_start;                   // rate window start
+   uint64_t win_count;                   // arrivals at window start
+   double   rate;                        // last achieved rate in Hz
+   uint64_t alarms[WD_COUNT];
+};
+
+static struct wdrep wd[256];
+static float wd_frac = 0.5;              // min fraction of the set rate
+static uint32_t wd_deadline = 250;       // stall deadline in msecs
+static int wd_run = 0;
+static int wd_trip = 0;                  // alarm for the reader
+static int wd_held = 0;                  // recovery runs, no checks
+static int wd_resume = 0;                // restart all deadlines
+static pthread_t wd_thread, wd_reader;
+static const char *wd_name[WD_COUNT] = { "stall", "slow" };
+
+/* ------------------------------------------------------------ *
+ * wd_parse() - "frac[:msec]", min rate fraction and deadline   *
+ * ------------------------------------------------------------ */
+int wd_parse(char *spec) {
+   if(sscanf(spec, "%f:%u", &wd_frac, &wd_deadline) < 1
+      || wd_frac <= 0 || wd_frac >= 1 || wd_deadline == 0) {
+      printf("Error: Cannot get valid --watchdog frac[:msec] argument.\n");
+      return(-1);
+   }
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_expect() - report repid was set to interval usecs, 0 off. *
+ * Called by set_feature(), restarts the report's deadline.     *
+ * ------------------------------------------------------------ */
+void wd_expect(uint8_t repid, uint32_t interval) {
+   if(__atomic_load_n(&wd_run, __ATOMIC_RELAXED) == 0) return;
+   __atomic_store_n(&wd[repid].last, stats_now(), __ATOMIC_RELAXED);
+   __atomic_store_n(&wd[repid].expect, interval, __ATOMIC_RELEASE);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_arrival() - an input report repid came in                 *
+ * ------------------------------------------------------------ */
+void wd_arrival(uint8_t repid) {
+   if(__atomic_load_n(&wd_run, __ATOMIC_RELAXED) == 0) return;
+   __atomic_store_n(&wd[repid].last, stats_now(), __ATOMIC_RELAXED);
+   __atomic_add_fetch(&wd[repid].count, 1, __ATOMIC_RELAXED);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_alarm() - count the alarm and interrupt the reader. The   *
+ * signal ends a blocked I2C read with EINTR, the reader sees   *
+ * wd_tripped() and recovers. The report gets a new deadline.   *
+ * ------------------------------------------------------------ */
+static void wd_alarm(uint8_t repid, wdalarm_t kind, uint64_t now) {
+   struct wdrep *r = &wd[repid];
+   r->alarms[kind]++;
+   r->win_start = now;
+   r->win_count = __atomic_load_n(&r->count, __ATOMIC_RELAXED);
+   __atomic_store_n(&r->last, now, __ATOMIC_RELAXED);
+   if(verbose == 1) printf("Debug: Watchdog %s alarm report [%02X] %.1f Hz\n",
+                            wd_name[kind], repid, r->rate);
+   __atomic_store_n(&wd_trip, 1, __ATOMIC_RELEASE);
+   pthread_kill(wd_reader, SIGALRM);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_check() - stall and rate check of one enabled report      *
+ * ------------------------------------------------------------ */
+static void wd_check(uint8_t repid, uint64_t now) {
+   struct wdrep *r = &wd[repid];
+   uint32_t expect = __atomic_load_n(&r->expect, __ATOMIC_ACQUIRE);
+   if(expect == 0) return;
+   uint64_t span = WD_MIN_SAMPLES * (uint64_t) expect * 1000;
+
+   uint64_t deadline = wd_deadline * 1000000ULL;
+   if(deadline < span) deadline = span;
+   uint64_t last = __atomic_load_n(&r->last, __ATOMIC_RELAXED);
+   if(now > last && now - last > deadline) {
+      r->rate = 0;
+      wd_alarm(repid, WD_STALL, now);
+      return;
+   }
+
+   uint64_t window = WD_WINDOW_MS * 1000000ULL;
+   if(window < span) window = span;
+   if(r->win_start == 0 || last > now) r->win_start = now;
+   if(now - r->win_start < window) return;
+   uint64_t count = __atomic_load_n(&r->count, __ATOMIC_RELAXED);
+   r->rate = (count - r->win_count) * 1e9 / (now - r->win_start);
+   r->win_start = now;
+   r->win_count = count;
+   if(r->rate < wd_frac * 1e6 / expect) wd_alarm(repid, WD_SLOW, now);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_loop() - the watchdog thread                              *
+ * ------------------------------------------------------------ */
+static void *wd_loop(void *arg) {
+   while(__atomic_load_n(&wd_run, __ATOMIC_RELAXED)) {
+      usleep(WD_TICK_MS * 1000);
+      if(__atomic_load_n(&wd_held, __ATOMIC_ACQUIRE)) continue;
+      uint64_t now = stats_now();
+      if(__atomic_exchange_n(&wd_resume, 0, __ATOMIC_ACQ_REL)) {
+         // the recovery is over: new deadlines and rate windows
+         for(int id = 0; id < 256; id++) {
+            __atomic_store_n(&wd[id].last, now, __ATOMIC_RELAXED);
+            wd[id].win_start = 0;
+         }
+         continue;
+      }
+      for(int id = 0; id < 256; id++) wd_check(id, now);
+   }
+   return(NULL);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_hold() - hold 1 pauses the checks while the recovery runs *
+ * and blocks SIGALRM, so no alarm cuts a reset wait short. An  *
+ * alarm raised before is dropped. hold 0 resumes, all reports  *
+ * get a new deadline. Called by bno_recover() on the reader.   *
+ * ------------------------------------------------------------ */
+void wd_hold(int hold) {
+   if(__atomic_load_n(&wd_run, __ATOMIC_RELAXED) == 0) return;
+   sigset_t set;
+   sigemptyset(&set);
+   sigaddset(&set, SIGALRM);
+   if(hold) {
+      __atomic_store_n(&wd_held, 1, __ATOMIC_RELEASE);
+      pthread_sigmask(SIG_BLOCK, &set, NULL);
+      return;
+   }
+   __atomic_store_n(&wd_trip, 0, __ATOMIC_RELAXED);
+   __atomic_store_n(&wd_resume, 1, __ATOMIC_RELAXED);
+   __atomic_store_n(&wd_held, 0, __ATOMIC_RELEASE);
+   pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+}
+
+static void wd_sigalrm(int sig) {
+   // only interrupts the blocked system call
+}
+
+/* ------------------------------------------------------------ *
+ * wd_start() - watch the reports of the calling thread, which  *
+ * is the reader. SIGALRM is set without SA_RESTART, so it ends *
+ * a blocked read. Returns 0 or -1.                             *
+ * ------------------------------------------------------------ */
+int wd_start() {
+   struct sigaction sa;
+   memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = wd_sigalrm;
+   sigaction(SIGALRM, &sa, NULL);
+
+   wd_reader = pthread_self();
+   __atomic_store_n(&wd_run, 1, __ATOMIC_RELAXED);
+   uint64_t now = stats_now();
+   for(int id = 0; id < 256; id++) {
+      if(featureInterval[id] == 0) continue;
+      wd[id].last = now;
+      wd[id].expect = featureInterval[id];
+   }
+   if(pthread_create(&wd_thread, NULL, wd_loop, NULL) != 0) {
+      printf("Error: Cannot start the watchdog thread.\n");
+      wd_run = 0;
+      return(-1);
+   }
+   if(verbose == 1) printf("Debug: Watchdog at %.0f%% of the set rates, %u ms deadline\n",
+                            wd_frac * 100, wd_deadline);
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_tripped() - 1 once after an alarm, the reader recovers    *
+ * ------------------------------------------------------------ */
+int wd_tripped() {
+   if(__atomic_load_n(&wd_trip, __ATOMIC_ACQUIRE) == 0) return(0);
+   __atomic_store_n(&wd_trip, 0, __ATOMIC_RELAXED);
+   return(1);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_stop() - end the watchdog thread                          *
+ * ------------------------------------------------------------ */
+void wd_stop() {
+   if(__atomic_load_n(&wd_run, __ATOMIC_RELAXED) == 0) return;
+   __atomic_store_n(&wd_run, 0, __ATOMIC_RELAXED);
+   pthread_join(wd_thread, NULL);
+}
+
+/* ------------------------------------------------------------ *
+ * wd_print() - rate and alarms per watched report for --stats  *
+ * ------------------------------------------------------------ */
+void wd_print(FILE *fp) {
+   fprintf(fp, "\nBNO080 report watchdog, alarm below %.0f%% rate or %u ms silent\n",
+           wd_frac * 100, wd_deadline);
+   fprintf(fp, "-----------------------------------------------------------------------------\n");
+   fprintf(fp, "Report     set Hz   last Hz    stall     slow\n");
+   for(int id = 0; id < 256; id++) {
+      if(wd[id].expect == 0) continue;
+      const struct repdesc *d = report_desc(id);
+      fprintf(fp, "%02X %-4s %8.1f %9.1f %8llu %8llu\n", id, (d != NULL) ? d->name : "?",
+              1e6 / wd[id].expect, wd[id].rate,
+              (unsigned long long) wd[id].alarms[WD_STALL],
+              (unsigned long long) wd[id].alarms[WD_SLOW]);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * prom_wd() - watchdog alarms in Prometheus text format        *
+ * ------------------------------------------------------------ */
+int prom_wd(char *p, int size) {
+   if(__atomic_load_n(&wd_run, __ATOMIC_RELAXED) == 0) return(0);
+   int n = snprintf(p, size, "# HELP bno080_watchdog_alarms_total Report stall and low rate alarms.\n"
+                             "# TYPE bno080_watchdog_alarms_total counter\n");
+   for(int id = 0; id < 256 && n < size; id++) {
+      if(wd[id].expect == 0) continue;
+      const struct repdesc *d = report_desc(id);
+      for(int k = 0; k < WD_COUNT && n < size; k++)
+         n += snprintf(p+n, size-n, "bno080_watchdog_alarms_total{report=\"%s\",kind=\"%s\"} %llu\n",
+                       (d != NULL) ? d->name : "unknown", wd_name[k],
+                       (unsigned long long) wd[id].alarms[k]);
+   }
+   return(n < size ? n : size - 1);
+}
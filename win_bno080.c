@@ -0,0 +1,148 @@
+/* ------------------------------------------------------------ *
+ * file:        win_bno080.c                                    *
+ * purpose:     Windowed sample buffers for batch analytics.    *
+ *              Each window stores the axis values, timestamps  *
+ *              and accuracy in separate, 64-byte aligned       *
+ *              arrays (structure of arrays). When a window is  *
+ *              full, its callback gets a read-only view of the *
+ *              arrays, no copy, no transpose.                  *
+ *              Feeds --window statistics and --filter batches. *
+ *                                                              *
+ * author:      10/18/2026 agent                                *
+ * ------------------------------------------------------------ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "getbno080.h"
+
+// Windows that can be registered for the sample stream
+#define WIN_MAX 8
+
+static struct bnowin *windows[WIN_MAX];
+static int nwindows = 0;
+
+/* ------------------------------------------------------------ *
+ * win_init() - allocate window w for report repid, closed after*
+ * span_us microseconds or max samples, whichever comes first.  *
+ * Array lengths are rounded up to full 64-byte lines, so each  *
+ * array starts aligned. Returns 0, or -1 if out of memory.     *
+ * ------------------------------------------------------------ */
+int win_init(struct bnowin *w, uint8_t repid, uint32_t span_us, int max,
+             void (*done)(const struct bnowin*, void*), void *arg) {
+   memset(w, 0, sizeof(struct bnowin));
+   int cap = (max + WIN_LINE - 1) & ~(WIN_LINE - 1);   // 32 int16 per line
+   size_t vbytes = cap * sizeof(int16_t);
+   size_t tbytes = cap * sizeof(uint32_t);
+
+   if(posix_memalign(&w->mem, WIN_ALIGN, 4 * vbytes + tbytes + cap) != 0) {
+      printf("Error: cannot allocate %d sample window.\n", cap);
+      return(-1);
+   }
+   uint8_t *p = w->mem;
+   for(int i = 0; i < 4; i++, p += vbytes) w->v[i] = (int16_t *) p;
+   w->ts = (uint32_t *) p;
+   w->acc = p + tbytes;
+
+   w->repid = repid;
+   w->span = span_us;
+   w->cap = max;
+   w->done = done;
+   w->arg = arg;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * win_free() - release the window arrays                       *
+ * ------------------------------------------------------------ */
+void win_free(struct bnowin *w) {
+   free(w->mem);
+   w->mem = NULL;
+}
+
+/* ------------------------------------------------------------ *
+ * win_close() - hand the filled window to its callback, then   *
+ * start the next one in the same arrays.                       *
+ * ------------------------------------------------------------ */
+void win_close(struct bnowin *w) {
+   if(w->len == 0) return;
+   w->done(w, w->arg);
+   w->seq++;
+   w->len = 0;
+}
+
+/* ------------------------------------------------------------ *
+ * win_push() - append one sample. The window is closed first   *
+ * if the sample falls after its time span, and after it if the *
+ * window is full.                                              *
+ * ------------------------------------------------------------ */
+void win_push(struct bnowin *w, struct bnosample *smp) {
+   if(w->len > 0 && smp->ts - w->ts[0] >= w->span) win_close(w);
+
+   int n = w->len;
+   if(n == 0) {
+      w->q = smp->q;
+      w->count = SAMPLE_COUNT(smp);
+   }
+   w->v[0][n] = smp->v[0];
+   w->v[1][n] = smp->v[1];
+   w->v[2][n] = smp->v[2];
+   w->v[3][n] = smp->v[3];
+   w->ts[n] = smp->ts;
+   w->acc[n] = smp->acc;
+   w->len = n + 1;
+
+   if(w->len == w->cap) win_close(w);
+}
+
+/* ------------------------------------------------------------ *
+ * win_add() - register a window to be fed by win_feed()        *
+ * ------------------------------------------------------------ */
+int win_add(struct bnowin *w) {
+   if(nwindows == WIN_MAX) return(-1);
+   windows[nwindows++] = w;
+   return(0);
+}
+
+/* ------------------------------------------------------------ *
+ * win_feed() - pass a decoded sample to all windows registered *
+ * for its report ID. Called from the sampling loop.            *
+ * ------------------------------------------------------------ */
+void win_feed(struct bnosample *smp) {
+   for(int i = 0; i < nwindows; i++) {
+      if(windows[i]->repid == smp->repid) win_push(windows[i], smp);
+   }
+}
+
+/* ------------------------------------------------------------ *
+ * win_flush() - close all partly filled windows, at stream end *
+ * ------------------------------------------------------------ */
+void win_flush() {
+   for(int i = 0; i < nwindows; i++) win_close(windows[i]);
+}
+
+/* ------------------------------------------------------------ *
+ * win_print() - window callback for --window: prints the mean, *
+ * min and max per axis. The loops run over contiguous arrays   *
+ * and auto-vectorize.                                          *
+ * ------------------------------------------------------------ */
+void win_print(const struct bnowin *w, void *arg) {
+   FILE *fp = arg;
+   int n = w->len;
+
+   fprintf(fp, "win %u report %d n %d span %u us", w->seq, w->repid, n,
+           w->ts[n-1] - w->ts[0]);
+   for(int a = 0; a < w->count; a++) {
+      const int16_t *v = w->v[a];
+      int64_t sum = 0;
+      int16_t min = v[0], max = v[0];
+      for(int i = 0; i < n; i++) {
+         sum += v[i];
+         min = (v[i] < min) ? v[i] : min;
+         max = (v[i] > max) ? v[i] : max;
+      }
+      fprintf(fp, " | %.4f %.4f %.4f", ldexp((double) sum / n, -w->q),
+              qToFloat(min, w->q), qToFloat(max, w->q));
+   }
+   fprintf(fp, "\n");
+}